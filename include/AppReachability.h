@@ -0,0 +1,60 @@
+//========================================================================
+// FILE:
+//    AppReachability.h
+//
+// DESCRIPTION:
+//    Declares the AppReachability analysis
+//      * new pass manager interface
+//
+//    AppReachability is the part of the call graph that runs at all: the
+//    functions reachable from the application roots (main, RTOS tasks and
+//    ISRs, see getAppRoots()) and from the static initializers. It is
+//    computed once from the cached CallGraphAnalysis and shared by the
+//    reports that start from the application roots. Like FindMMIOSites, it
+//    is part of the FindMMIOFunc plugin.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_APPREACHABILITY_H
+#define LLVM_TUTOR_APPREACHABILITY_H
+
+#include "CallPaths.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct AppReachability : public llvm::AnalysisInfoMixin<AppReachability> {
+  struct Result {
+    // From getAppRoots()
+    CallPaths App;
+    // From the static initializers (getGlobalCtors())
+    CallPaths Ctors;
+
+    bool reaches(const llvm::Function *F) const {
+      return App.reaches(F) || Ctors.reaches(F);
+    }
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  static Result runOnModule(llvm::Module &M, const llvm::CallGraph &CG);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<AppReachability>;
+};
+
+// Registers the AppReachability analysis. Called from the FindMMIOFunc
+// plugin.
+void registerAppReachability(llvm::PassBuilder &PB);
+
+#endif // LLVM_TUTOR_APPREACHABILITY_H
@@ -0,0 +1,57 @@
+//========================================================================
+// FILE:
+//    CallPaths.h
+//
+// DESCRIPTION:
+//    Declares CallPaths, the functions reachable from a set of roots in the
+//    call graph together with one shortest call path to each of them, and
+//    helpers to find common roots (static initializers, interrupt
+//    handlers, RTOS tasks).
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_CALLPATHS_H
+#define LLVM_TUTOR_CALLPATHS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include <vector>
+
+class CallPaths {
+public:
+  // Breadth-first search of CG from Roots. Calls through function pointers
+  // are not followed.
+  CallPaths(const llvm::CallGraph &CG,
+            llvm::ArrayRef<const llvm::Function *> Roots);
+
+  bool reaches(const llvm::Function *F) const { return Parent.count(F); }
+  // Root, ..., F (empty if F isn't reachable)
+  std::vector<const llvm::Function *> getPath(const llvm::Function *F) const;
+  // Number of calls from the closest root to F
+  unsigned getDepth(const llvm::Function *F) const;
+  // The reachable functions, roots first, in breadth-first order
+  const std::vector<const llvm::Function *> &functions() const {
+    return Order;
+  }
+
+private:
+  // Caller on the shortest path (null for roots)
+  llvm::DenseMap<const llvm::Function *, const llvm::Function *> Parent;
+  std::vector<const llvm::Function *> Order;
+};
+
+// The constructors listed in @llvm.global_ctors, in priority order
+std::vector<const llvm::Function *> getGlobalCtors(const llvm::Module &M);
+
+// True if F is an interrupt handler: *_IRQHandler, *_isr, has the
+// `interrupt` attribute or is listed with -isr
+bool isISR(const llvm::Function &F);
+// The interrupt handlers defined in M
+std::vector<const llvm::Function *> getISRs(const llvm::Module &M);
+// Where application code starts running: main, the FreeRTOS tasks created
+// with xTaskCreate[Static]() and the interrupt handlers
+std::vector<const llvm::Function *> getAppRoots(const llvm::Module &M);
+
+#endif // LLVM_TUTOR_CALLPATHS_H
@@ -0,0 +1,48 @@
+//========================================================================
+// FILE:
+//    ChangeScope.h
+//
+// DESCRIPTION:
+//    Declares ChangeScope, the functions touched by a change: the functions
+//    defined in the changed source files (-changed-files, or
+//    `git diff --name-only HEAD` with -changed-from-git) and their direct
+//    callers and callees. Used to restrict the MMIO scan for quick,
+//    pre-commit runs.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_CHANGESCOPE_H
+#define LLVM_TUTOR_CHANGESCOPE_H
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Error.h"
+#include <string>
+#include <vector>
+
+class ChangeScope {
+public:
+  // Computes the scope from the command line options. Without a change
+  // set, every function is in scope.
+  void configure(const llvm::Module &M);
+  bool isEnabled() const { return Enabled; }
+  bool contains(const llvm::Function *F) const {
+    return !Enabled || Scope.count(F);
+  }
+  size_t size() const { return Scope.size(); }
+
+private:
+  bool Enabled = false;
+  llvm::DenseSet<const llvm::Function *> Scope;
+};
+
+// The files listed by `git diff --name-only HEAD` in the current directory,
+// relative to the root of the repository
+llvm::Expected<std::vector<std::string>> getGitChangedFiles();
+
+// True if Path (absolute, or relative to the compilation directory) is
+// Changed, or ends with it when Changed is relative
+bool isSameSourceFile(llvm::StringRef Path, llvm::StringRef Changed);
+
+#endif // LLVM_TUTOR_CHANGESCOPE_H
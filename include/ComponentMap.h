@@ -0,0 +1,56 @@
+//========================================================================
+// FILE:
+//    ComponentMap.h
+//
+// DESCRIPTION:
+//    Declares ComponentMap, a lookup table from source files to the build
+//    component (CMake target) that compiles them. It is populated from
+//      * compile_commands.json, or
+//      * a CMake file-API codemodel reply (.cmake/api/v1/reply)
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_COMPONENTMAP_H
+#define LLVM_TUTOR_COMPONENTMAP_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include <string>
+#include <vector>
+
+class ComponentMap {
+public:
+  static constexpr unsigned None = ~0U;
+
+  llvm::Error loadCompileCommands(llvm::StringRef Path);
+  llvm::Error loadFileAPIReply(llvm::StringRef ReplyDir);
+
+  // Returns the index of the component that compiles File (an absolute,
+  // normalized path), or None.
+  unsigned lookup(llvm::StringRef File) const;
+  llvm::StringRef getName(unsigned Component) const {
+    return Components[Component];
+  }
+  unsigned size() const { return Components.size(); }
+
+  // Recovers the CMake target from an object file path or archive member:
+  //   "src/CMakeFiles/nrf-sdk.dir/foo.c.o" -> "nrf-sdk"
+  //   "src/libnrf-sdk.a(foo.c.o)"          -> "nrf-sdk"
+  static llvm::StringRef getTargetFromObjectPath(llvm::StringRef Output);
+  bool empty() const { return Files.empty(); }
+
+private:
+  unsigned getOrAddComponent(llvm::StringRef Name);
+  void addFile(llvm::StringRef Dir, llvm::StringRef File, unsigned Component);
+
+  std::vector<std::string> Components;
+  llvm::StringMap<unsigned> ComponentIds;
+  llvm::StringMap<unsigned> Files;
+};
+
+// Makes File absolute (relative to Dir) and removes "." and ".." components,
+// so that paths from the build system and from debug info compare equal.
+std::string normalizePath(llvm::StringRef Dir, llvm::StringRef File);
+
+#endif // LLVM_TUTOR_COMPONENTMAP_H
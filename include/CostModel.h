@@ -0,0 +1,66 @@
+//========================================================================
+// FILE:
+//    CostModel.h
+//
+// DESCRIPTION:
+//    Declares CostModel, a static estimate of the time a function spends
+//    talking to hardware:
+//      * straight-line instructions (one cycle each),
+//      * polling loops, i.e. loops that exit on a value read from MMIO
+//        (`while (!NRF_UART0->EVENTS_TXDRDY);`), at a fixed cost each,
+//      * calls to known delay functions (nrf_delay_ms, HAL_Delay,
+//        vTaskDelay, k_busy_wait, ...) with a constant argument.
+//
+//    Only the body of the function itself is costed, callees are not
+//    included. Loops are counted once, so the estimate is a per-call lower
+//    bound, good enough to rank functions. The constants can be tuned with
+//    -cpu-mhz, -poll-cost-us and -tick-rate-hz.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_COSTMODEL_H
+#define LLVM_TUTOR_COSTMODEL_H
+
+#include "FindMMIOSites.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Instructions.h"
+#include <memory>
+#include <vector>
+
+struct FunctionCost {
+  unsigned Instructions = 0;
+  // Exit conditions of polling loops: MMIO loads or calls returning MMIO
+  // values (e.g. nrf_gpio_pin_read())
+  std::vector<const llvm::Instruction *> Polls;
+  // Delay calls and their duration in us (0 if not a constant)
+  std::vector<std::pair<const llvm::CallBase *, double>> Delays;
+
+  double getDelayUs() const;
+  // Instructions + polls + delays
+  double getEstimatedUs() const;
+};
+
+class CostModel {
+public:
+  explicit CostModel(const FindMMIOSites::Result &Sites) : Sites(Sites) {}
+  // Memoized per function
+  const FunctionCost &getCost(const llvm::Function &F);
+
+  // The duration of a call to a known delay function in us, 0 if the
+  // duration isn't a constant, or None if Call isn't a delay
+  static llvm::Optional<double> getDelayUs(const llvm::CallBase &Call);
+  // The estimate for the given numbers of instructions and polling loops and
+  // total delay
+  static double estimateUs(unsigned Instructions, size_t Polls,
+                           double DelayUs);
+
+private:
+  // The MMIO read that V, the condition of a loop exit, depends on, or null
+  const llvm::Instruction *findPolledRead(const llvm::Value *V) const;
+
+  const FindMMIOSites::Result &Sites;
+  llvm::DenseMap<const llvm::Function *, std::unique_ptr<FunctionCost>> Costs;
+};
+
+#endif // LLVM_TUTOR_COSTMODEL_H
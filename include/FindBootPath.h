@@ -0,0 +1,81 @@
+//========================================================================
+// FILE:
+//    FindBootPath.h
+//
+// DESCRIPTION:
+//    Declares the FindBootPath Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDBOOTPATH_H
+#define LLVM_TUTOR_FINDBOOTPATH_H
+
+#include "FindMMIOSites.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindBootPath : public llvm::AnalysisInfoMixin<FindBootPath> {
+  // Work done on the boot path: a call made by a function on the path
+  // before the path continues, including everything it calls
+  struct Segment {
+    // Function on the boot path (null for code that runs before main when
+    // the reset handler isn't part of the module, e.g. SystemInit)
+    const llvm::Function *Caller;
+    // Callee == Caller for the body of Caller itself
+    const llvm::Function *Callee;
+    unsigned MMIOAccesses = 0;
+    std::vector<const llvm::Instruction *> Polls;
+    std::vector<std::pair<const llvm::CallBase *, double>> Delays;
+    // Peripherals written to, i.e. initialized
+    std::vector<std::string> Peripherals;
+    double EstimatedUs = 0;
+  };
+  struct Result {
+    // Entry, ..., main, ..., target
+    std::vector<const llvm::Function *> Path;
+    // Most expensive first
+    std::vector<Segment> Segments;
+    double EstimatedUs = 0;
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     const llvm::CallGraph &CG);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindBootPath>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindBootPathPrinter : public llvm::PassInfoMixin<FindBootPathPrinter> {
+public:
+  explicit FindBootPathPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDBOOTPATH_H
@@ -0,0 +1,85 @@
+//========================================================================
+// FILE:
+//    FindCriticalSections.h
+//
+// DESCRIPTION:
+//    Declares the FindCriticalSections Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDCRITICALSECTIONS_H
+#define LLVM_TUTOR_FINDCRITICALSECTIONS_H
+
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindCriticalSections
+    : public llvm::AnalysisInfoMixin<FindCriticalSections> {
+  // The code run with interrupts disabled, from a call that disables them
+  // to the calls that enable them again
+  struct Section {
+    const llvm::Function *Func;
+    const llvm::Instruction *Enter;
+    std::vector<const llvm::Instruction *> Exits;
+    // True if some path returns from Func with interrupts still disabled
+    bool Unclosed = false;
+    // Including the callees
+    unsigned Instructions = 0;
+    unsigned MMIOAccesses = 0;
+    std::vector<const llvm::Instruction *> Polls;
+    std::vector<std::pair<const llvm::CallBase *, double>> Delays;
+    std::vector<const llvm::Function *> Callees;
+    // Callees that access MMIO directly, bypassing the HAL
+    std::vector<const llvm::Function *> Bypasses;
+    double EstimatedUs = 0;
+
+    bool isBusyWait() const { return !Polls.empty() || !Delays.empty(); }
+  };
+  // Sections that access MMIO or call HAL bypasses, longest first
+  using Result = std::vector<Section>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     const FindMMIOFunc::Result &MMIOFuncs,
+                     const llvm::CallGraph &CG);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindCriticalSections>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindCriticalSectionsPrinter
+    : public llvm::PassInfoMixin<FindCriticalSectionsPrinter> {
+public:
+  explicit FindCriticalSectionsPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDCRITICALSECTIONS_H
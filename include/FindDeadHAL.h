@@ -0,0 +1,75 @@
+//========================================================================
+// FILE:
+//    FindDeadHAL.h
+//
+// DESCRIPTION:
+//    Declares the FindDeadHAL Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDDEADHAL_H
+#define LLVM_TUTOR_FINDDEADHAL_H
+
+#include "AppReachability.h"
+#include "FindHALCoverage.h"
+#include "FindMMIOSites.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindDeadHAL : public llvm::AnalysisInfoMixin<FindDeadHAL> {
+  // A HAL function that is never called, while bypasses access its registers
+  struct Shadowed {
+    const llvm::Function *HAL;
+    // The number of registers the HAL function accesses
+    unsigned Registers;
+    // The first access of a bypass to each of those registers
+    std::vector<const MMIOSite *> BypassSites;
+    // The distinct bypasses among BypassSites, by name
+    std::vector<const llvm::Function *> Bypasses;
+  };
+  struct Result {
+    // Most bypassed registers first
+    std::vector<Shadowed> Functions;
+    // HAL functions that are never called, with or without bypasses
+    unsigned DeadHAL = 0;
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindHALCoverage::Result &Coverage,
+                     const AppReachability::Result &Reachable);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindDeadHAL>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindDeadHALPrinter : public llvm::PassInfoMixin<FindDeadHALPrinter> {
+public:
+  explicit FindDeadHALPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDDEADHAL_H
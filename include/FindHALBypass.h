@@ -16,6 +16,7 @@
 #include "FindMMIOFunc.h"
 
 //#include "llvm/ADT/MapVector.h"
+#include "llvm/Analysis/CallGraph.h"
 #include "llvm/IR/AbstractCallSite.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/PassManager.h"
@@ -29,9 +30,13 @@
 //using ResultStaticCC = llvm::MapVector<const llvm::Function *, unsigned>;
 
 struct FindHALBypass : public llvm::AnalysisInfoMixin<FindHALBypass> {
-  using Result = std::vector<const llvm::Function *>;
+  // The calls to non-HAL MMIO functions: (caller, callee). The caller is
+  // null for the call graph's external node.
+  using Result =
+      std::vector<std::pair<const llvm::Function *, const llvm::Function *>>;
   Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
-  Result runOnModule(llvm::Module &M, const FindMMIOFunc::Result &);
+  Result runOnModule(llvm::Module &M, const FindMMIOFunc::Result &,
+                     const llvm::CallGraph &CG);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -0,0 +1,98 @@
+//========================================================================
+// FILE:
+//    FindHALCoverage.h
+//
+// DESCRIPTION:
+//    Declares the FindHALCoverage Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+//    FindHALCoverage indexes the MMIO registers accessed by HAL functions and
+//    suggests, for every HAL bypass, the HAL functions that already access
+//    the registers the bypass does. Like FindMMIOSites, it is part of the
+//    FindMMIOFunc plugin so that other reports can use the index.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDHALCOVERAGE_H
+#define LLVM_TUTOR_FINDHALCOVERAGE_H
+
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindHALCoverage : public llvm::AnalysisInfoMixin<FindHALCoverage> {
+  // The HAL functions that could replace a bypass
+  struct Suggestion {
+    // The representative of the bypass (see foldInstantiations())
+    const llvm::Function *Bypass;
+    // The first access of the bypass to every register it accesses, and
+    // the HAL functions accessing the same register
+    std::vector<std::pair<const MMIOSite *,
+                          llvm::ArrayRef<const llvm::Function *>>>
+        Registers;
+    // HAL functions and how many of the registers above they access, most
+    // first
+    std::vector<std::pair<const llvm::Function *, unsigned>> Candidates;
+  };
+
+  struct Result {
+    // Register address -> the HAL functions that access it, by name
+    llvm::DenseMap<uint64_t, std::vector<const llvm::Function *>>
+        HALByRegister;
+    // HAL function -> the registers it accesses, in address order
+    llvm::DenseMap<const llvm::Function *, std::vector<uint64_t>>
+        RegistersByHAL;
+    // One entry per bypass called by the application
+    std::vector<Suggestion> Suggestions;
+
+    llvm::ArrayRef<const llvm::Function *> getHALFunctions(uint64_t Addr) const;
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     const FindMMIOFunc::Result &MMIOFuncs);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindHALCoverage>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindHALCoveragePrinter
+    : public llvm::PassInfoMixin<FindHALCoveragePrinter> {
+public:
+  explicit FindHALCoveragePrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+// Registers "print<hal-coverage>" and the FindHALCoverage analysis. Called
+// from the FindMMIOFunc plugin.
+void registerFindHALCoverage(llvm::PassBuilder &PB);
+
+#endif // LLVM_TUTOR_FINDHALCOVERAGE_H
@@ -0,0 +1,81 @@
+//========================================================================
+// FILE:
+//    FindIRQStorm.h
+//
+// DESCRIPTION:
+//    Declares the FindIRQStorm Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDIRQSTORM_H
+#define LLVM_TUTOR_FINDIRQSTORM_H
+
+#include "FindMMIOSites.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindIRQStorm : public llvm::AnalysisInfoMixin<FindIRQStorm> {
+  // An event register read by an ISR that isn't cleared on every path
+  struct Violation {
+    const llvm::Function *ISR;
+    // The read of the EVENTS register
+    const MMIOSite *Read;
+    std::string Register;
+    // ISR, ..., function containing the read
+    std::vector<const llvm::Function *> Path;
+  };
+  using Result = std::vector<Violation>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     const llvm::CallGraph &CG);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindIRQStorm>;
+
+  // True if every path from From to a return of its function clears the
+  // event register at Addr, or finds it not set
+  bool clearsOnAllPaths(const llvm::Instruction *From, uint64_t Addr);
+  // True if calling F always clears the event register at Addr
+  bool alwaysClears(const llvm::Function *F, uint64_t Addr);
+  bool isClear(const llvm::Instruction &I, uint64_t Addr);
+
+  const FindMMIOSites::Result *Sites = nullptr;
+  // Memoized alwaysClears(); false while being computed (recursion)
+  llvm::DenseMap<std::pair<const llvm::Function *, uint64_t>, bool> Clears;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindIRQStormPrinter : public llvm::PassInfoMixin<FindIRQStormPrinter> {
+public:
+  explicit FindIRQStormPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDIRQSTORM_H
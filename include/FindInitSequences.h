@@ -0,0 +1,79 @@
+//========================================================================
+// FILE:
+//    FindInitSequences.h
+//
+// DESCRIPTION:
+//    Declares the FindInitSequences Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDINITSEQUENCES_H
+#define LLVM_TUTOR_FINDINITSEQUENCES_H
+
+#include "FindMMIOSites.h"
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindInitSequences : public llvm::AnalysisInfoMixin<FindInitSequences> {
+  // Constant register writes an init function makes to one peripheral, in
+  // program order, that always execute together
+  struct InitSequence {
+    const llvm::Function *Func;
+    std::string Peripheral;
+    uint64_t Base;
+    // (offset from Base, value)
+    std::vector<std::pair<uint64_t, uint64_t>> Writes;
+    // The table needs 32-bit values (or offsets)
+    bool Wide = false;
+    // Estimated Thumb-2 code size of the stores, and of a table plus the
+    // loop that replays it
+    unsigned UnrolledBytes = 0;
+    unsigned TableBytes = 0;
+
+    int getSavedBytes() const { return (int)UnrolledBytes - (int)TableBytes; }
+  };
+  // Sequences that would shrink with a table, largest saving first
+  using Result = std::vector<InitSequence>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     llvm::FunctionAnalysisManager &FAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindInitSequences>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindInitSequencesPrinter
+    : public llvm::PassInfoMixin<FindInitSequencesPrinter> {
+public:
+  explicit FindInitSequencesPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDINITSEQUENCES_H
@@ -13,6 +13,12 @@
 #ifndef LLVM_TUTOR_FINDMMIOFUNC_H
 #define LLVM_TUTOR_FINDMMIOFUNC_H
 
+#include "AppReachability.h"
+#include "FindMMIOSites.h"
+#include "LayerClassifier.h"
+
+#include "llvm/ADT/DenseSet.h"
+
 //#include "llvm/ADT/MapVector.h"
 #include "llvm/IR/AbstractCallSite.h"
 #include "llvm/IR/Module.h"
@@ -20,6 +26,9 @@
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
 #include <map>
+#include <memory>
+#include <string>
+#include <vector>
 
 //------------------------------------------------------------------------------
 // New PM interface
@@ -34,10 +43,25 @@ struct FindMMIOFunc : public llvm::AnalysisInfoMixin<FindMMIOFunc> {
     const llvm::Instruction *MMIOIns;
     bool CalledByApp;
     const llvm::Function *Caller;
+    // The MMIO address and, if known, the peripheral it belongs to
+    uint64_t Addr = 0;
+    std::string Peripheral;
+    uint64_t PeripheralBase = 0;
+    // Called by the application and not in the -mmio-cache of the previous
+    // run
+    bool New = false;
   };
   using Result = std::map<const llvm::Function *, NonHalMMIOFunc>;
+  // The call graph and the app reachability are only computed when needed
+  // (not for -changed-files/-changed-from-git runs without -mmio-stream)
+  using CallGraphGetter = llvm::function_ref<const llvm::CallGraph &()>;
+  using ReachabilityGetter =
+      llvm::function_ref<const AppReachability::Result &()>;
+
   Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
-  Result runOnModule(llvm::Module &M);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     CallGraphGetter GetCG,
+                     ReachabilityGetter GetReachable);
   // Part of the official API:
   //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
   static bool isRequired() { return true; }
@@ -48,16 +72,49 @@ private:
   static llvm::AnalysisKey Key;
   friend struct llvm::AnalysisInfoMixin<FindMMIOFunc>;
 
-  template <typename InstTy>
-  bool isMMIOInst_(llvm::Instruction *Ins);
-  bool isMMIOInst(llvm::Instruction *Ins);
+  LayerClassifier Classifier;
+  // -mmio-scan-stats: the scan cost from FindMMIOSites, plus the cost of
+  // classifying every function. Null when disabled.
+  std::unique_ptr<ScanStats> Stats;
+
   bool isHalFunc(const llvm::Function &F);
   bool isAppFunc(const llvm::Function &F);
-  bool containHalStr(const std::string &Str);
-  void findNonHalMMIOFunc(llvm::Module &M, Result &MMIOFuncs);
-  void checkCalledByApp(llvm::Module &M, Result &MMIOFuncs);
+  void findNonHalMMIOFunc(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                          Result &MMIOFuncs);
+  void checkCalledByApp(const ChangeScope &Scope, CallGraphGetter GetCG,
+                        Result &MMIOFuncs);
+  // -mmio-stream: prints F if an application function calls it directly
+  void streamDirectAppCallers(const llvm::Function &F,
+                              const NonHalMMIOFunc &Info);
+  // -mmio-stream: prints the remaining findings and their call paths
+  void streamRefinements(const Result &MMIOFuncs,
+                         const AppReachability::Result &Reachable);
+  // The findings printed by streamDirectAppCallers()
+  llvm::DenseSet<const llvm::Function *> Streamed;
+  // Marks the new findings and updates the -mmio-cache file
+  void updateCache(llvm::Module &M, const ChangeScope &Scope,
+                   Result &MMIOFuncs);
 };
 
+// The built-in heuristics, for the functions no layer rule classifies: HAL
+// functions have "hal" in their name or file name, and everything outside
+// of SDK and lib directories may be application code
+bool isHalByName(const llvm::Function &F);
+bool mayBeAppByPath(const llvm::Function &F);
+
+// Findings of the template instantiations of one function (e.g.
+// Spi<0>::Write and Spi<1>::Write) whose MMIO access is at the same source
+// location. Instances[0] is the representative (smallest name).
+struct MMIOFuncGroup {
+  std::vector<const llvm::Function *> Instances;
+};
+
+// Folds the findings of Res into one group per source site, ordered by the
+// name of the representative. Findings without debug info are never folded.
+// With AppOnly, only the functions called by the application are kept.
+std::vector<MMIOFuncGroup> foldInstantiations(const FindMMIOFunc::Result &Res,
+                                              bool AppOnly);
+
 //------------------------------------------------------------------------------
 // New PM interface for the printer pass
 //------------------------------------------------------------------------------
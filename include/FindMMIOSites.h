@@ -0,0 +1,147 @@
+//========================================================================
+// FILE:
+//    FindMMIOSites.h
+//
+// DESCRIPTION:
+//    Declares the FindMMIOSites Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+//    FindMMIOSites lists every load and store through a constant MMIO
+//    address in the module (HAL functions included), and every instruction
+//    that passes such an address on (e.g. to a helper function). It is the
+//    shared MMIO scan that FindMMIOFunc and the other analyses build on.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDMMIOSITES_H
+#define LLVM_TUTOR_FINDMMIOSITES_H
+
+#include "ChangeScope.h"
+#include "ScanStats.h"
+#include "MemoryMap.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+// A load or store through a constant MMIO address, or an instruction that
+// passes a constant MMIO address on
+struct MMIOSite {
+  static constexpr unsigned NoPeripheral = ~0U;
+
+  const llvm::Instruction *Ins;
+  // The accessed address, i.e. the constant base plus all constant offsets
+  uint64_t Addr;
+  bool IsStore;
+  // False if the access has a variable index (e.g. NRF_GPIO->PIN_CNF[Pin]),
+  // in which case Addr is the address of element 0
+  bool Exact;
+  // True if Ins doesn't access Addr but passes it on: a call argument
+  // (nrf_gpio_port_out_set(&NRF_P0->OUT, ...)), a stored or a returned
+  // pointer. Whoever gets it may access any register of the peripheral from
+  // there, so these sites are never Exact.
+  bool AddressTaken;
+  // Index into FindMMIOSites::Result::Peripherals, or NoPeripheral
+  unsigned Peripheral;
+  // The stored value, if it is a constant
+  llvm::Optional<uint64_t> StoredValue;
+
+  const llvm::Function *getFunction() const { return Ins->getFunction(); }
+  bool isLoad() const { return !IsStore && !AddressTaken; }
+};
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindMMIOSites : public llvm::AnalysisInfoMixin<FindMMIOSites> {
+  struct Result {
+    // All sites, in module order. The sites of a function are contiguous.
+    std::vector<MMIOSite> Sites;
+    // The devicetree peripherals accessed by the sites
+    std::vector<Region> Peripherals;
+    // The functions that were scanned (all, unless -changed-files or
+    // -changed-from-git is given)
+    ChangeScope Scope;
+    // The cost of scanning every function, with -mmio-scan-stats
+    ScanStats Stats;
+
+    llvm::ArrayRef<MMIOSite> getSites(const llvm::Function *F) const;
+    // The site of Ins, or null if Ins isn't an MMIO access
+    const MMIOSite *getSite(const llvm::Instruction *Ins) const;
+    const Region *getPeripheral(const MMIOSite &S) const {
+      return S.Peripheral == MMIOSite::NoPeripheral ? nullptr
+                                                    : &Peripherals[S.Peripheral];
+    }
+    // The base address of the peripheral S accesses: the devicetree node if
+    // known, otherwise the enclosing 4 KiB block (the peripheral size on
+    // nRF5x and STM32)
+    uint64_t getPeripheralBase(const MMIOSite &S) const;
+    // The devicetree label, or the base address in hex
+    std::string getPeripheralName(const MMIOSite &S) const;
+    // The register S accesses by its nRF5x name, e.g. "&uart0.EVENTS[0x108]",
+    // "&uart0.ENABLE" or "0x40002000[0x524]"
+    std::string getRegisterName(const MMIOSite &S) const;
+    NRFRegister getRegister(const MMIOSite &S) const {
+      return getNRFRegister(S.Addr - getPeripheralBase(S));
+    }
+
+    // [Begin, End) into Sites for every function with MMIO accesses
+    llvm::DenseMap<const llvm::Function *, std::pair<unsigned, unsigned>>
+        FuncSites;
+    llvm::DenseMap<const llvm::Instruction *, unsigned> InstSites;
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindMMIOSites>;
+
+  AddressClassifier Addresses;
+};
+
+// Resolves the constant address that Ptr points to, if any. Constant offsets
+// (struct fields, constant array indices) are added to the base. Variable
+// indices are dropped and reported through Exact.
+llvm::Optional<uint64_t> getConstantAddress(const llvm::Value *Ptr,
+                                            const llvm::DataLayout &DL,
+                                            bool &Exact);
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindMMIOSitesPrinter : public llvm::PassInfoMixin<FindMMIOSitesPrinter> {
+public:
+  explicit FindMMIOSitesPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+// Registers "print<mmio-sites>" and the FindMMIOSites analysis. Called from
+// the FindMMIOFunc plugin, which FindMMIOSites is part of.
+void registerFindMMIOSites(llvm::PassBuilder &PB);
+
+// Formats "file:line:col" of Ins (or "<no debug info>")
+std::string getDebugLocString(const llvm::Instruction *Ins);
+
+#endif // LLVM_TUTOR_FINDMMIOSITES_H
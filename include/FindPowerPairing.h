@@ -0,0 +1,88 @@
+//========================================================================
+// FILE:
+//    FindPowerPairing.h
+//
+// DESCRIPTION:
+//    Declares the FindPowerPairing Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDPOWERPAIRING_H
+#define LLVM_TUTOR_FINDPOWERPAIRING_H
+
+#include "AppReachability.h"
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindPowerPairing : public llvm::AnalysisInfoMixin<FindPowerPairing> {
+  // A peripheral enabled (or started) with no disable (or stop) after it
+  struct Unpaired {
+    const MMIOSite *Enable;
+    std::string Register;
+    std::string Peripheral;
+    // App root, ..., function containing the enable
+    std::vector<const llvm::Function *> Path;
+    // The enable is made by a non-HAL function
+    bool HALBypass;
+  };
+  using Result = std::vector<Unpaired>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     const FindMMIOFunc::Result &MMIOFuncs,
+                     const llvm::CallGraph &CG,
+                     const AppReachability::Result &Reachable);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindPowerPairing>;
+
+  // True if the peripheral at Base may be disabled after From, in From's
+  // function or, after returning, in one of its callers
+  bool isDisabledAfter(const llvm::Instruction *From, uint64_t Base,
+                       unsigned Depth);
+  // True if F or one of its callees disables the peripheral at Base
+  bool mayDisable(const llvm::Function *F, uint64_t Base);
+
+  const FindMMIOSites::Result *Sites = nullptr;
+  const llvm::CallGraph *CG = nullptr;
+  llvm::DenseMap<std::pair<const llvm::Function *, uint64_t>, bool> Disables;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindPowerPairingPrinter
+    : public llvm::PassInfoMixin<FindPowerPairingPrinter> {
+public:
+  explicit FindPowerPairingPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDPOWERPAIRING_H
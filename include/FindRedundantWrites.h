@@ -0,0 +1,110 @@
+//========================================================================
+// FILE:
+//    FindRedundantWrites.h
+//
+// DESCRIPTION:
+//    Declares the FindRedundantWrites Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDREDUNDANTWRITES_H
+#define LLVM_TUTOR_FINDREDUNDANTWRITES_H
+
+#include "FindMMIOSites.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindRedundantWrites
+    : public llvm::AnalysisInfoMixin<FindRedundantWrites> {
+  // A store, or a call, that writes a register with the value it already
+  // holds
+  struct RedundantWrite {
+    // The store, or the call to the function that stores
+    const llvm::Instruction *Ins;
+    uint64_t Addr;
+    std::string Register;
+    uint64_t Value;
+    // The write that already set the value (null for writes repeated by a
+    // loop)
+    const llvm::Instruction *Previous;
+    // Every iteration of the enclosing loop writes the same value again
+    bool InLoop;
+  };
+  using Result = std::vector<RedundantWrite>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+  // The register values known at a program point, and the writes that set
+  // them
+  struct Known {
+    uint64_t Value;
+    // The store that wrote the value, possibly in a callee
+    const MMIOSite *Site;
+    // The store, or the call that led to it
+    const llvm::Instruction *Writer;
+  };
+  using State = std::map<uint64_t, Known>;
+
+  // What a call to a function does to the registers
+  struct Summary {
+    // Registers (addresses) and peripherals (bases) possibly written
+    llvm::DenseSet<uint64_t> Writes;
+    llvm::DenseSet<uint64_t> WrittenPeripherals;
+    // Calls unknown code that might write any register
+    bool WritesAll = false;
+    // Registers written with a constant on every path
+    State Exit;
+  };
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindRedundantWrites>;
+
+  const Summary &getSummary(const llvm::Function &F);
+  // Runs the dataflow over F. Redundant writes are added to Report, if set.
+  State analyze(const llvm::Function &F, Result *Report);
+  // Applies I to S, reporting redundant writes
+  void transfer(const llvm::Instruction &I, State &S, Result *Report);
+  void findLoopWrites(const llvm::Function &F, Result &Report);
+
+  const FindMMIOSites::Result *Sites = nullptr;
+  llvm::DenseMap<const llvm::Function *, std::unique_ptr<Summary>> Summaries;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindRedundantWritesPrinter
+    : public llvm::PassInfoMixin<FindRedundantWritesPrinter> {
+public:
+  explicit FindRedundantWritesPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDREDUNDANTWRITES_H
@@ -0,0 +1,123 @@
+//========================================================================
+// FILE:
+//    FindRuleSets.h
+//
+// DESCRIPTION:
+//    Declares the FindRuleSets Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+//    FindRuleSets finds the non-HAL MMIO functions called by the
+//    application (see FindMMIOFunc) under several layer rule sets at once
+//    (-rule-sets). Bit I of every RuleSetMask stands for rule set I. Like
+//    FindMMIOSites, it is part of the FindMMIOFunc plugin.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDRULESETS_H
+#define LLVM_TUTOR_FINDRULESETS_H
+
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+#include "LayerClassifier.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/raw_ostream.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One bit per rule set
+using RuleSetMask = uint64_t;
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindRuleSets : public llvm::AnalysisInfoMixin<FindRuleSets> {
+  static constexpr unsigned MaxRuleSets = 64;
+
+  // A function with MMIO accesses, and the rule sets that flag it
+  struct Finding {
+    const llvm::Function *Func;
+    // The first MMIO access of Func
+    const MMIOSite *Site;
+    // The rule sets that don't classify Func as HAL...
+    RuleSetMask NonHAL = 0;
+    // ...and the ones under which an application function calls it
+    RuleSetMask CalledByApp = 0;
+
+    RuleSetMask getFlagged() const { return NonHAL & CalledByApp; }
+  };
+
+  struct Result {
+    // The name of every rule set, by bit
+    std::vector<std::string> Names;
+    // In module order
+    std::vector<Finding> Findings;
+
+    RuleSetMask getAll() const {
+      return Names.size() == MaxRuleSets ? ~RuleSetMask(0)
+                                         : (RuleSetMask(1) << Names.size()) - 1;
+    }
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  // GetCG is only called when the call graph is needed (not for
+  // -changed-files/-changed-from-git runs)
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     FindMMIOFunc::CallGraphGetter GetCG);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindRuleSets>;
+
+  // The rule sets under which F is a HAL function, and under which it may
+  // be an application function
+  struct LayerMasks {
+    RuleSetMask HAL = 0;
+    RuleSetMask App = 0;
+  };
+  const LayerMasks &classify(const llvm::Function &F);
+
+  // Loads the rule sets of -rule-sets into Classifiers
+  void configure(Result &Res);
+  void checkCalledByApp(const ChangeScope &Scope,
+                        FindMMIOFunc::CallGraphGetter GetCG, Result &Res);
+
+  std::vector<std::unique_ptr<LayerClassifier>> Classifiers;
+  llvm::DenseMap<const llvm::Function *, LayerMasks> Masks;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindRuleSetsPrinter : public llvm::PassInfoMixin<FindRuleSetsPrinter> {
+public:
+  explicit FindRuleSetsPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+// True if rule sets were given with -rule-sets
+bool hasRuleSets();
+
+// Registers "print<mmio-func-rule-sets>" and the FindRuleSets analysis.
+// Called from the FindMMIOFunc plugin.
+void registerFindRuleSets(llvm::PassBuilder &PB);
+
+#endif // LLVM_TUTOR_FINDRULESETS_H
@@ -0,0 +1,79 @@
+//========================================================================
+// FILE:
+//    FindStartupMMIO.h
+//
+// DESCRIPTION:
+//    Declares the FindStartupMMIO Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDSTARTUPMMIO_H
+#define LLVM_TUTOR_FINDSTARTUPMMIO_H
+
+#include "CostModel.h"
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindStartupMMIO : public llvm::AnalysisInfoMixin<FindStartupMMIO> {
+  // A function reachable from a static initializer that accesses MMIO,
+  // polls or delays
+  struct StartupFunc {
+    const llvm::Function *Func;
+    // Shortest call path from the static initializer
+    std::vector<const llvm::Function *> Path;
+    llvm::ArrayRef<MMIOSite> Sites;
+    // Non-HAL function that accesses MMIO directly
+    bool HALBypass;
+    FunctionCost Cost;
+  };
+  struct Initializer {
+    const llvm::Function *Ctor;
+    std::vector<StartupFunc> Funcs;
+    double EstimatedUs = 0;
+  };
+  using Result = std::vector<Initializer>;
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites,
+                     const FindMMIOFunc::Result &MMIOFuncs,
+                     const llvm::CallGraph &CG);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindStartupMMIO>;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindStartupMMIOPrinter
+    : public llvm::PassInfoMixin<FindStartupMMIOPrinter> {
+public:
+  explicit FindStartupMMIOPrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+#endif // LLVM_TUTOR_FINDSTARTUPMMIO_H
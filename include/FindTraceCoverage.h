@@ -0,0 +1,99 @@
+//========================================================================
+// FILE:
+//    FindTraceCoverage.h
+//
+// DESCRIPTION:
+//    Declares the FindTraceCoverage Passes
+//      * new pass manager interface
+//      * printer pass for the new pass manager
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_FINDTRACECOVERAGE_H
+#define LLVM_TUTOR_FINDTRACECOVERAGE_H
+
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+#include "TraceReader.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// New PM interface
+//------------------------------------------------------------------------------
+struct FindTraceCoverage : public llvm::AnalysisInfoMixin<FindTraceCoverage> {
+  // Accesses to an address that no static site predicts
+  struct Gap {
+    uint64_t Addr;
+    uint64_t Count;
+    bool Write;
+    // The first access
+    llvm::Optional<uint64_t> PC;
+    std::string SourceLoc;
+  };
+
+  struct Result {
+    // Trace accesses matched to each site, indexed like
+    // FindMMIOSites::Result::Sites
+    std::vector<uint64_t> SiteCounts;
+    // Most frequent first
+    std::vector<Gap> Gaps;
+    uint64_t Lines = 0;
+    uint64_t Accesses = 0;
+    uint64_t Matched = 0;
+    // Overlong lines, and gaps beyond -trace-max-gaps
+    uint64_t SkippedLines = 0;
+    uint64_t DroppedGaps = 0;
+    // False if no trace was given or it couldn't be read
+    bool Loaded = false;
+  };
+
+  Result run(llvm::Module &M, llvm::ModuleAnalysisManager &);
+  Result runOnModule(llvm::Module &M, const FindMMIOSites::Result &Sites);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  // A special type used by analysis passes to provide an address that
+  // identifies that particular analysis pass type.
+  static llvm::AnalysisKey Key;
+  friend struct llvm::AnalysisInfoMixin<FindTraceCoverage>;
+
+  // The static sites that may have made A (indices into Sites)
+  void match(const TraceAccess &A, llvm::SmallVectorImpl<unsigned> &Matches);
+
+  const FindMMIOSites::Result *Sites = nullptr;
+  // Sites by address, and the sites with a variable index by peripheral
+  llvm::DenseMap<uint64_t, llvm::SmallVector<unsigned, 2>> ByAddr;
+  llvm::DenseMap<uint64_t, llvm::SmallVector<unsigned, 2>> IndexedByBase;
+};
+
+//------------------------------------------------------------------------------
+// New PM interface for the printer pass
+//------------------------------------------------------------------------------
+class FindTraceCoveragePrinter
+    : public llvm::PassInfoMixin<FindTraceCoveragePrinter> {
+public:
+  explicit FindTraceCoveragePrinter(llvm::raw_ostream &OutS) : OS(OutS) {}
+  llvm::PreservedAnalyses run(llvm::Module &M,
+                              llvm::ModuleAnalysisManager &MAM);
+  // Part of the official API:
+  //  https://llvm.org/docs/WritingAnLLVMNewPMPass.html#required-passes
+  static bool isRequired() { return true; }
+
+private:
+  llvm::raw_ostream &OS;
+};
+
+// True if a trace was given with -mmio-trace
+bool hasMMIOTrace();
+
+#endif // LLVM_TUTOR_FINDTRACECOVERAGE_H
@@ -0,0 +1,104 @@
+/*========================================================================
+ * FILE:
+ *    HALBypass.h
+ *
+ * DESCRIPTION:
+ *    C interface of the HALBypass library, for tools that embed the
+ *    analyses in-process instead of running them through opt:
+ *
+ *      HBAnalysisRef A = HBAnalyzeFile("app.bc", &Err);
+ *      HBCursorRef C = HBGetMMIOFuncs(A);
+ *      while (HBCursorNext(C))
+ *        if (HBCursorIsCalledByApp(C))
+ *          report(HBCursorGetFunction(C), HBCursorGetAddress(C));
+ *      HBDisposeCursor(C);
+ *      HBDisposeAnalysis(A);
+ *
+ *    Results are read through cursors and returned as LLVM values and plain
+ *    integers; nothing is formatted. Names can be obtained from the values
+ *    with the LLVM C API (LLVMGetValueName2, LLVMGetDebugLocLine, ...).
+ *
+ *    The options of the passes (-mmio-profile, -devicetree, ...) are
+ *    set with HBSetOptions().
+ *
+ * License: MIT
+ *========================================================================*/
+#ifndef LLVM_TUTOR_HALBYPASS_H
+#define LLVM_TUTOR_HALBYPASS_H
+
+#include "llvm-c/Types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HBOpaqueAnalysis *HBAnalysisRef;
+typedef struct HBOpaqueCursor *HBCursorRef;
+
+/* Parses the options in Argv (Argv[0] is the program name) the way opt
+ * would. Must be called before the first analysis. Returns 0 on error, in
+ * which case the reason has been printed to stderr. */
+int HBSetOptions(int Argc, const char *const *Argv);
+
+/* Parses an IR or bitcode file and analyzes it. The module is owned by the
+ * analysis. Returns NULL on error and sets *ErrorMessage, which must be
+ * freed with LLVMDisposeMessage(). */
+HBAnalysisRef HBAnalyzeFile(const char *Path, char **ErrorMessage);
+
+/* Analyzes a module owned by the caller, which must outlive the analysis and
+ * must not be modified while it is in use */
+HBAnalysisRef HBAnalyzeModule(LLVMModuleRef M);
+
+/* Disposes of the analysis (and of the module, for HBAnalyzeFile). Cursors
+ * must be disposed of first. */
+void HBDisposeAnalysis(HBAnalysisRef A);
+
+/* The module the analysis ran on */
+LLVMModuleRef HBGetModule(HBAnalysisRef A);
+
+/*------------------------------------------------------------------------
+ * Cursors
+ *------------------------------------------------------------------------*/
+/* Every load and store through a constant MMIO address, HAL included, in
+ * module order (FindMMIOSites) */
+HBCursorRef HBGetMMIOSites(HBAnalysisRef A);
+
+/* The non-HAL functions that access MMIO, with their first access
+ * (FindMMIOFunc) */
+HBCursorRef HBGetMMIOFuncs(HBAnalysisRef A);
+
+/* Moves to the next item; returns 0 past the last one. A new cursor is
+ * positioned before the first item. */
+int HBCursorNext(HBCursorRef C);
+
+void HBDisposeCursor(HBCursorRef C);
+
+/* The accessors below refer to the current item */
+
+/* The function containing the access */
+LLVMValueRef HBCursorGetFunction(HBCursorRef C);
+/* The load or store, or the instruction passing the address on */
+LLVMValueRef HBCursorGetInstruction(HBCursorRef C);
+/* The accessed address */
+uint64_t HBCursorGetAddress(HBCursorRef C);
+/* 1 for a store, 0 for a load or for an address passed on without an access
+ * (e.g. to a helper function) */
+int HBCursorIsStore(HBCursorRef C);
+/* The devicetree peripheral accessed (not null-terminated; *Len receives the
+ * length) and its base address in *Base, or NULL if the address isn't in a
+ * known peripheral. The name is owned by the analysis. */
+const char *HBCursorGetPeripheral(HBCursorRef C, size_t *Len, uint64_t *Base);
+
+/* HBGetMMIOFuncs only: 1 if an application function calls the function, in
+ * which case HBCursorGetCaller() returns one of them */
+int HBCursorIsCalledByApp(HBCursorRef C);
+LLVMValueRef HBCursorGetCaller(HBCursorRef C);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LLVM_TUTOR_HALBYPASS_H */
@@ -0,0 +1,215 @@
+//========================================================================
+// FILE:
+//    LayerClassifier.h
+//
+// DESCRIPTION:
+//    Declares the rule-based layer classifier used by FindMMIOFunc
+//      * Layer - the architectural layer a function belongs to
+//      * ComponentTrie - longest-prefix match over name components
+//      * NamespaceClassifier - layer lookup by (demangled) C++ namespace
+//      * PathClassifier - layer lookup by source directory
+//      * ComponentMap (see ComponentMap.h) - layer lookup by build target
+//      * PrefixRules - layer lookup by symbol or section name prefix
+//      * LinkerMap (see LinkerMap.h) - layer lookup by object file/archive
+//      * LayerRules - the rules of one configuration (command line or file)
+//      * LayerClassifier - combines all the configured rule sources
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_LAYERCLASSIFIER_H
+#define LLVM_TUTOR_LAYERCLASSIFIER_H
+
+#include "ComponentMap.h"
+#include "LinkerMap.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Demangle/Demangle.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/Error.h"
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Layers
+//------------------------------------------------------------------------------
+enum class Layer { Unknown, App, HAL, ThirdParty };
+
+// Parses "app", "hal" (or "driver") and "third-party" (or "lib"). Returns
+// Layer::Unknown for anything else.
+Layer parseLayer(llvm::StringRef Name);
+llvm::StringRef getLayerName(Layer L);
+
+// Splits a "<key>=<layer>" rule as given on the command line. Returns false
+// if the rule is malformed.
+bool parseLayerRule(llvm::StringRef Rule, llvm::StringRef &Key, Layer &L);
+
+//------------------------------------------------------------------------------
+// ComponentTrie
+//------------------------------------------------------------------------------
+// A trie over name components (namespaces, directories, ...). Every node may
+// carry a layer; lookups return the layer of the deepest (i.e. longest)
+// matching prefix, so that more specific rules take precedence.
+class ComponentTrie {
+public:
+  ComponentTrie() : Nodes(1) {}
+
+  void insert(llvm::ArrayRef<llvm::StringRef> Components, Layer L);
+  Layer lookup(llvm::ArrayRef<llvm::StringRef> Components) const;
+  bool empty() const { return Nodes.size() == 1 && !Nodes[0].HasLayer; }
+
+private:
+  struct Node {
+    llvm::StringMap<unsigned> Children;
+    Layer L = Layer::Unknown;
+    bool HasLayer = false;
+  };
+  // Node 0 is the root
+  std::vector<Node> Nodes;
+};
+
+//------------------------------------------------------------------------------
+// NamespaceClassifier
+//------------------------------------------------------------------------------
+// Maps Itanium-mangled linkage names to layers based on their enclosing
+// namespace, e.g. "Pinetime::Drivers" -> hal. Every linkage name is
+// demangled at most once.
+class NamespaceClassifier {
+public:
+  NamespaceClassifier() = default;
+  NamespaceClassifier(NamespaceClassifier &&Other);
+  NamespaceClassifier &operator=(NamespaceClassifier &&) = delete;
+  ~NamespaceClassifier();
+
+  void addRule(llvm::StringRef Prefix, Layer L);
+  bool empty() const { return Trie.empty(); }
+
+  // The "::"-separated declaration context of LinkageName, or "" if it
+  // isn't a mangled C++ function name.
+  llvm::StringRef getNamespacePath(llvm::StringRef LinkageName);
+  Layer classify(llvm::StringRef LinkageName);
+
+private:
+  struct Entry {
+    std::string Path;
+    Layer L;
+  };
+  const Entry &lookup(llvm::StringRef LinkageName);
+
+  llvm::ItaniumPartialDemangler Demangler;
+  // Scratch buffer handed to the demangler (malloc'd, grown on demand)
+  char *Buf = nullptr;
+  size_t BufSize = 0;
+  llvm::StringMap<Entry> Cache;
+  ComponentTrie Trie;
+};
+
+// Splits a qualified C++ name at top-level "::" (i.e. not inside template
+// arguments or parameter lists).
+void splitQualifiedName(llvm::StringRef Name,
+                        llvm::SmallVectorImpl<llvm::StringRef> &Components);
+
+//------------------------------------------------------------------------------
+// PathClassifier
+//------------------------------------------------------------------------------
+// Maps source paths to layers, e.g. "src/drivers" -> hal, "src/libs/lvgl" ->
+// third-party, "src" -> app. Rules and paths are compared component-wise
+// (so "lib" doesn't match "calibration") and the longest rule wins.
+class PathClassifier {
+public:
+  // Relative prefixes are resolved against Root
+  void addRule(llvm::StringRef Root, llvm::StringRef Prefix, Layer L);
+  bool empty() const { return Trie.empty(); }
+  // Path has to be absolute and normalized (see normalizePath)
+  Layer classify(llvm::StringRef Path) const;
+
+private:
+  ComponentTrie Trie;
+};
+
+//------------------------------------------------------------------------------
+// PrefixRules
+//------------------------------------------------------------------------------
+// Plain string prefix rules, e.g. "nrf_" -> hal for C symbols or ".text.hal"
+// -> hal for sections. The longest matching prefix wins.
+class PrefixRules {
+public:
+  void addRule(llvm::StringRef Prefix, Layer L);
+  bool empty() const { return Rules.empty(); }
+  Layer classify(llvm::StringRef Name) const;
+
+private:
+  // Sorted by decreasing prefix length
+  std::vector<std::pair<std::string, Layer>> Rules;
+};
+
+//------------------------------------------------------------------------------
+// LayerRules
+//------------------------------------------------------------------------------
+// The rules of one configuration, as given with the options below
+struct LayerRules {
+  std::vector<std::string> NamespaceLayers;
+  std::vector<std::string> PathLayers;
+  std::vector<std::string> TargetLayers;
+  std::vector<std::string> SymbolLayers;
+  std::vector<std::string> SectionLayers;
+  std::string SourceRoot;
+  std::string CompileCommands;
+  std::string CMakeFileAPI;
+  std::string LinkerMapFile;
+
+  // The rules given on the command line
+  static LayerRules fromCommandLine();
+  // Reads a rule set file: one "<option>=<value>" per line, with the names
+  // of the command line options, e.g. "path-layer=src/drivers=hal". Lines
+  // starting with '#' are comments.
+  static llvm::Expected<LayerRules> load(llvm::StringRef Path);
+};
+
+//------------------------------------------------------------------------------
+// LayerClassifier
+//------------------------------------------------------------------------------
+// Entry point used by the passes. Returns Layer::Unknown when none of the
+// configured rules apply, in which case callers fall back to their built-in
+// heuristics. The rules are tried in this order:
+//   1. directory rules, then build target rules (need debug info)
+//   2. namespace rules
+//   3. section rules, then symbol prefix rules
+//   4. build target of the defining object file according to the linker map
+// Only 1. needs debug info, so stripped (-g0) bitcode can be classified too.
+class LayerClassifier {
+public:
+  // Populates the rules from the command line options (once)
+  void configure();
+  // Populates the rules from Rules instead (once)
+  void configure(const LayerRules &Rules);
+  Layer classify(const llvm::Function &F);
+  // The layer of a source file, as far as the file-based rules go
+  Layer classifyFile(const llvm::DIFile *File);
+  // The layer of a function, as far as the rules that don't need debug info
+  // go
+  Layer classifySymbol(const llvm::Function &F);
+
+private:
+  bool Configured = false;
+  NamespaceClassifier Namespaces;
+  PathClassifier Paths;
+
+  ComponentMap Components;
+  // Layer of every component in Components
+  std::vector<Layer> ComponentLayers;
+  // Memoized per DIFile, so that each path is normalized only once
+  llvm::DenseMap<const llvm::DIFile *, Layer> FileLayers;
+
+  PrefixRules Sections;
+  PrefixRules Symbols;
+
+  LinkerMap Map;
+  // Layer of every origin (object file) in Map
+  std::vector<Layer> OriginLayers;
+};
+
+#endif // LLVM_TUTOR_LAYERCLASSIFIER_H
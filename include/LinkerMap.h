@@ -0,0 +1,44 @@
+//========================================================================
+// FILE:
+//    LinkerMap.h
+//
+// DESCRIPTION:
+//    Declares LinkerMap, a symbol -> input file (object or archive member)
+//    table read from a GNU ld map file (-Wl,-Map=<file>). Used to classify
+//    functions in bitcode that has no debug info.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_LINKERMAP_H
+#define LLVM_TUTOR_LINKERMAP_H
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include <string>
+#include <vector>
+
+class LinkerMap {
+public:
+  llvm::Error load(llvm::StringRef Path);
+
+  static constexpr unsigned None = ~0U;
+
+  bool empty() const { return Symbols.empty(); }
+
+  // The input file (origin) that defines Symbol, or None. Origins are e.g.
+  // "libnrf-sdk.a(nrfx_twim.c.o)" or "CMakeFiles/infinitime.dir/main.cpp.o".
+  unsigned lookup(llvm::StringRef Symbol) const;
+  unsigned getNumOrigins() const { return Origins.size(); }
+  llvm::StringRef getOrigin(unsigned Id) const { return Origins[Id]; }
+
+private:
+  unsigned getOrAddOrigin(llvm::StringRef Origin);
+  void addSymbol(llvm::StringRef Symbol, unsigned Origin);
+
+  std::vector<std::string> Origins;
+  llvm::StringMap<unsigned> OriginIds;
+  llvm::StringMap<unsigned> Symbols;
+};
+
+#endif // LLVM_TUTOR_LINKERMAP_H
@@ -0,0 +1,233 @@
+//========================================================================
+// FILE:
+//    MemoryMap.h
+//
+// DESCRIPTION:
+//    Declares the target memory-map profiles used to decide whether a
+//    constant address is MMIO:
+//      * AddressRange - a half-open [Begin, End) address range
+//      * profile::* - constexpr MMIO range tables for common targets
+//      * MemoryProfile - run-time selection of a profile
+//      * RegionTable - sorted table of named regions loaded at run time
+//      * AddressClassifier - combines the profile and the loaded regions, for
+//        single addresses or in bulk (SIMD)
+//      * NRFRegister - the common register layout of nRF5x peripherals
+//
+//    The range checks are branch-free: each range is tested with a single
+//    unsigned comparison and the results are OR-ed together, which the
+//    compiler fully unrolls for the (compile-time sized) tables.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_MEMORYMAP_H
+#define LLVM_TUTOR_MEMORYMAP_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//------------------------------------------------------------------------------
+// Address ranges
+//------------------------------------------------------------------------------
+struct AddressRange {
+  uint64_t Begin;
+  uint64_t End; // exclusive
+  const char *Name;
+};
+
+// Addresses below Begin wrap around to huge values, so one comparison
+// covers both bounds.
+constexpr bool inRange(const AddressRange &R, uint64_t Addr) {
+  return Addr - R.Begin < R.End - R.Begin;
+}
+
+template <size_t N>
+constexpr bool inAnyRange(const AddressRange (&Ranges)[N], uint64_t Addr) {
+  bool In = false;
+  for (size_t I = 0; I < N; ++I)
+    In |= inRange(Ranges[I], Addr);
+  return In;
+}
+
+//------------------------------------------------------------------------------
+// Target profiles
+//------------------------------------------------------------------------------
+namespace profile {
+// Every constant address is MMIO (no filtering)
+struct Any {
+  static constexpr bool isMMIO(uint64_t) { return true; }
+};
+
+// ARMv7-M/ARMv8-M architectural memory map
+struct CortexM {
+  static constexpr AddressRange MMIO[] = {
+      {0x40000000, 0x60000000, "Peripheral"},
+      {0xA0000000, 0xE0000000, "External device"},
+      {0xE0000000, 0xE0100000, "Private peripheral bus"},
+      {0xE0100000, 0x100000000, "Vendor system"},
+  };
+  static constexpr bool isMMIO(uint64_t Addr) { return inAnyRange(MMIO, Addr); }
+};
+
+// Nordic nRF52 series
+struct NRF52 {
+  static constexpr AddressRange MMIO[] = {
+      {0x10000000, 0x10001000, "FICR"},
+      {0x10001000, 0x10002000, "UICR"},
+      {0x40000000, 0x40080000, "APB/AHB peripherals"},
+      {0x50000000, 0x50001000, "GPIO"},
+      {0xE0000000, 0xE0100000, "Private peripheral bus"},
+  };
+  static constexpr bool isMMIO(uint64_t Addr) { return inAnyRange(MMIO, Addr); }
+};
+
+// ST STM32 (F/L/G families)
+struct STM32 {
+  static constexpr AddressRange MMIO[] = {
+      {0x40000000, 0x50000000, "APB/AHB1 peripherals"},
+      {0x50000000, 0x60000000, "AHB2 peripherals"},
+      {0xA0000000, 0xA0001000, "FMC/FSMC registers"},
+      {0xE0000000, 0xE0100000, "Private peripheral bus"},
+  };
+  static constexpr bool isMMIO(uint64_t Addr) { return inAnyRange(MMIO, Addr); }
+};
+
+// RISC-V platform interrupt controllers (SiFive layout). SoC peripherals
+// differ between vendors and are best described with a linker script or
+// devicetree.
+struct RISCV {
+  static constexpr AddressRange MMIO[] = {
+      {0x02000000, 0x02010000, "CLINT"},
+      {0x0C000000, 0x10000000, "PLIC"},
+  };
+  static constexpr bool isMMIO(uint64_t Addr) { return inAnyRange(MMIO, Addr); }
+};
+} // namespace profile
+
+//------------------------------------------------------------------------------
+// Profile selection
+//------------------------------------------------------------------------------
+enum class MemoryProfile { Any, CortexM, NRF52, STM32, RISCV };
+
+using AddressPredicate = bool (*)(uint64_t);
+
+// Returns the isMMIO predicate of the profile, instantiated for that
+// profile's range table
+AddressPredicate getMMIOPredicate(MemoryProfile P);
+// The MMIO range table of the profile (empty for MemoryProfile::Any)
+llvm::ArrayRef<AddressRange> getMMIORanges(MemoryProfile P);
+
+//------------------------------------------------------------------------------
+// Region tables
+//------------------------------------------------------------------------------
+struct Region {
+  enum KindTy { Memory, Peripheral };
+
+  uint64_t Begin;
+  uint64_t End; // exclusive
+  std::string Name;
+  KindTy Kind;
+};
+
+// Regions sorted by start address, looked up by binary search. Regions may
+// overlap or nest, in which case the one that starts last wins.
+class RegionTable {
+public:
+  void add(Region R) {
+    Regions.push_back(std::move(R));
+    Sorted = false;
+  }
+  // Must be called after the last add() and before find()
+  void sort();
+  // The region containing Addr, or null
+  const Region *find(uint64_t Addr) const;
+  bool empty() const { return Regions.empty(); }
+  const std::vector<Region> &regions() const { return Regions; }
+
+private:
+  std::vector<Region> Regions;
+  // MaxEnd[I] is the largest End among Regions[0..I]
+  std::vector<uint64_t> MaxEnd;
+  bool Sorted = true;
+};
+
+// Adds the regions declared in the MEMORY command of a GNU ld script as
+// Region::Memory
+llvm::Error loadLinkerScriptMemory(llvm::StringRef Path, RegionTable &Regions);
+
+// Adds the nodes with a `reg` property of a devicetree source (.dts) or of a
+// Zephyr devicetree_generated.h, named after their node labels
+llvm::Error loadDeviceTree(llvm::StringRef Path, RegionTable &Regions);
+
+//------------------------------------------------------------------------------
+// AddressClassifier
+//------------------------------------------------------------------------------
+// Entry point used by the passes. An address is MMIO if it is outside every
+// memory region declared in the linker scripts or devicetrees (if any) and
+// inside the MMIO ranges of the selected profile.
+class AddressClassifier {
+public:
+  // Loads the profile and regions from the command line options (once)
+  void configure();
+  bool isMMIO(uint64_t Addr) const {
+    return !MemoryRegions.find(Addr) && IsMMIOAddr(Addr);
+  }
+  // Same as isMMIO() for every address in Addrs, i.e.
+  //   Verdicts[I] = isMMIO(Addrs[I])
+  // The ranges are compared against several addresses at a time using SIMD
+  // instructions where the host supports them (SSE4.2/AVX2 on x86).
+  void classify(llvm::ArrayRef<uint64_t> Addrs,
+                llvm::MutableArrayRef<uint8_t> Verdicts) const;
+  // The devicetree peripheral that Addr belongs to, or null
+  const Region *getPeripheral(uint64_t Addr) const {
+    return Peripherals.find(Addr);
+  }
+
+private:
+  bool Configured = false;
+  AddressPredicate IsMMIOAddr = getMMIOPredicate(MemoryProfile::Any);
+  RegionTable MemoryRegions;
+  RegionTable Peripherals;
+
+  // Structure-of-arrays copies of the ranges for classify(). Ranges are
+  // stored as (Begin, End - Begin).
+  bool HasMMIORanges = false;
+  std::vector<uint64_t> MMIOBegins, MMIOSizes;
+  std::vector<uint64_t> MemoryBegins, MemorySizes;
+};
+
+// The range test behind AddressClassifier::classify():
+//   Out[I] = 1 if Addrs[I] is in any [Begins[J], Begins[J] + Sizes[J])
+// classify() uses the best kernel the host supports; the others are
+// reachable here so that they can be checked against the scalar loop.
+enum class ClassifyKernel { Scalar, SSE42, AVX2 };
+bool isClassifyKernelSupported(ClassifyKernel K);
+void inAnyRange(ClassifyKernel K, llvm::ArrayRef<uint64_t> Addrs,
+                llvm::ArrayRef<uint64_t> Begins, llvm::ArrayRef<uint64_t> Sizes,
+                llvm::MutableArrayRef<uint8_t> Out);
+
+//------------------------------------------------------------------------------
+// nRF5x register layout
+//------------------------------------------------------------------------------
+// Every nRF5x peripheral has its tasks, events, shortcuts, interrupt enable
+// and ENABLE registers at the same offsets from its (4 KiB aligned) base
+enum class NRFRegister {
+  Task,     // TASKS_*    0x000-0x0FC
+  Event,    // EVENTS_*   0x100-0x1FC
+  Shorts,   // SHORTS     0x200
+  IntEn,    // INTEN      0x300
+  IntEnSet, // INTENSET   0x304
+  IntEnClr, // INTENCLR   0x308
+  Enable,   // ENABLE     0x500
+  Other
+};
+
+NRFRegister getNRFRegister(uint64_t Offset);
+// "TASKS", "EVENTS", ..., or null for NRFRegister::Other
+const char *getNRFRegisterName(NRFRegister R);
+
+#endif // LLVM_TUTOR_MEMORYMAP_H
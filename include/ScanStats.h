@@ -0,0 +1,101 @@
+//========================================================================
+// FILE:
+//    ScanStats.h
+//
+// DESCRIPTION:
+//    Declares the optional per-function cost instrumentation of the MMIO
+//    scan (-mmio-scan-stats)
+//      * readCycleCounter - a cheap timestamp
+//      * ScanStats - scan and classification cost of every function
+//      * ClassifyTimer - adds the duration of a scope to a function's
+//        classification cost
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_SCANSTATS_H
+#define LLVM_TUTOR_SCANSTATS_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/raw_ostream.h"
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// The time stamp counter on x86, the virtual counter on AArch64 (both a few
+// cycles to read, no system call), nanoseconds elsewhere
+inline uint64_t readCycleCounter() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t Val;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(Val));
+  return Val;
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+// The unit of readCycleCounter()
+llvm::StringRef getCycleCounterUnit();
+
+// True with -mmio-scan-stats
+bool isScanStatsEnabled();
+
+class ScanStats {
+public:
+  struct FunctionCost {
+    const llvm::Function *Func;
+    uint64_t Instructions = 0;
+    // Looking for constant address loads/stores (FindMMIOSites)
+    uint64_t ScanCycles = 0;
+    // Layer classification (FindMMIOFunc)
+    uint64_t ClassifyCycles = 0;
+
+    uint64_t getTotal() const { return ScanCycles + ClassifyCycles; }
+  };
+
+  void addScan(const llvm::Function &F, uint64_t Instructions,
+               uint64_t Cycles);
+  void addClassify(const llvm::Function &F, uint64_t Cycles);
+  bool empty() const { return Costs.empty(); }
+
+  // Module-wide: the bulk address classification (AddressClassifier)
+  uint64_t AddressCycles = 0;
+
+  // Prints a histogram of the cost per function and the -mmio-scan-stats-top
+  // most expensive functions
+  void print(llvm::raw_ostream &OS) const;
+
+private:
+  FunctionCost &get(const llvm::Function &F);
+
+  // In the order the functions were first seen
+  std::vector<FunctionCost> Costs;
+  llvm::DenseMap<const llvm::Function *, unsigned> Index;
+};
+
+// Adds the duration of its lifetime to the classification cost of F in
+// Stats, if Stats isn't null
+class ClassifyTimer {
+public:
+  ClassifyTimer(ScanStats *Stats, const llvm::Function &F)
+      : Stats(Stats), F(F), Start(Stats ? readCycleCounter() : 0) {}
+  ~ClassifyTimer() {
+    if (Stats)
+      Stats->addClassify(F, readCycleCounter() - Start);
+  }
+
+private:
+  ScanStats *Stats;
+  const llvm::Function &F;
+  uint64_t Start;
+};
+
+#endif // LLVM_TUTOR_SCANSTATS_H
@@ -0,0 +1,48 @@
+//========================================================================
+// FILE:
+//    TraceReader.h
+//
+// DESCRIPTION:
+//    Declares the reader for peripheral access traces logged by emulators
+//      * TraceAccess - one logged access
+//      * parseTraceLine - parses one line of a trace
+//      * forEachTraceLine - streams a trace file line by line
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_TRACEREADER_H
+#define LLVM_TUTOR_TRACEREADER_H
+
+#include "llvm/ADT/Optional.h"
+#include "llvm/ADT/STLFunctionalExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Error.h"
+#include <cstdint>
+
+struct TraceAccess {
+  enum KindTy { Unknown, Read, Write };
+
+  uint64_t Addr = 0;
+  llvm::Optional<uint64_t> PC;
+  KindTy Kind = Unknown;
+  // Set if the trace is symbolized ("src/drivers/Spi.cpp:42"). Refers to
+  // the parsed line.
+  llvm::StringRef File;
+  unsigned Line = 0;
+};
+
+// Parses a line such as
+//   0x00001a2c 0x40002500 W 0x4                          (plain)
+//   sysbus: [cpu: 0x1A2C] WriteUInt32 to 0x40002500 ...  (Renode)
+//   ... pc=0x1a2c addr=0x40002500 write ...              (key=value)
+// Addresses must be absolute. Returns false for lines without an access.
+bool parseTraceLine(llvm::StringRef Line, TraceAccess &A);
+
+// Calls Fn for every line of Path ("-" for stdin). The file is read in
+// fixed-size chunks, so that memory use doesn't depend on the size of the
+// trace. Lines longer than a chunk are skipped and counted in *Skipped.
+llvm::Error forEachTraceLine(llvm::StringRef Path,
+                             llvm::function_ref<void(llvm::StringRef)> Fn,
+                             uint64_t *Skipped = nullptr);
+
+#endif // LLVM_TUTOR_TRACEREADER_H
@@ -0,0 +1,40 @@
+//==============================================================================
+// FILE:
+//    AppReachability.cpp
+//
+// DESCRIPTION:
+//    The functions reachable from the application roots and the static
+//    initializers, see AppReachability.h. The call graph is the one cached
+//    by the pass manager (CallGraphAnalysis), so the reports that need it
+//    don't build their own.
+//
+// License: MIT
+//==============================================================================
+#include "AppReachability.h"
+
+using namespace llvm;
+
+//------------------------------------------------------------------------------
+// AppReachability Implementation
+//------------------------------------------------------------------------------
+AppReachability::Result AppReachability::runOnModule(Module &M,
+                                                     const CallGraph &CG) {
+  return {CallPaths(CG, getAppRoots(M)), CallPaths(CG, getGlobalCtors(M))};
+}
+
+AppReachability::Result
+AppReachability::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  return runOnModule(M, MAM.getResult<CallGraphAnalysis>(M));
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey AppReachability::Key;
+
+void registerAppReachability(PassBuilder &PB) {
+  // REGISTRATION FOR "MAM.getResult<AppReachability>(Module)"
+  PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager &MAM) {
+    MAM.registerPass([&] { return AppReachability(); });
+  });
+}
@@ -0,0 +1,164 @@
+//==============================================================================
+// FILE:
+//    BatchClassify.cpp
+//
+// DESCRIPTION:
+//    Bulk classification of constant addresses, AddressClassifier::classify.
+//
+//    FindMMIOFunc collects the (de-duplicated) constant addresses of a module
+//    first and classifies all of them in one go. Every address is tested
+//    against every range with
+//
+//      Addr - Begin <u Size
+//
+//    which maps directly onto SIMD compares: 4 addresses at a time with AVX2,
+//    2 with SSE4.2. x86 has no unsigned 64-bit compare, so both sides are
+//    biased by 2^63 and compared signed. The kernel is picked at run time
+//    based on what the host CPU supports; other hosts use the scalar loop.
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+
+#include "llvm/Support/ErrorHandling.h"
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define HAL_BYPASS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+using namespace llvm;
+
+// Out[I] = 1 if Addrs[I] is in any of the R ranges, 0 otherwise
+using InAnyRangeFn = void (*)(const uint64_t *Addrs, size_t N,
+                              const uint64_t *Begins, const uint64_t *Sizes,
+                              size_t R, uint8_t *Out);
+
+static void inAnyRangeScalar(const uint64_t *Addrs, size_t N,
+                             const uint64_t *Begins, const uint64_t *Sizes,
+                             size_t R, uint8_t *Out) {
+  for (size_t I = 0; I < N; ++I) {
+    bool In = false;
+    for (size_t J = 0; J < R; ++J)
+      In |= Addrs[I] - Begins[J] < Sizes[J];
+    Out[I] = In;
+  }
+}
+
+#ifdef HAL_BYPASS_X86_SIMD
+__attribute__((target("avx2"))) static void
+inAnyRangeAVX2(const uint64_t *Addrs, size_t N, const uint64_t *Begins,
+               const uint64_t *Sizes, size_t R, uint8_t *Out) {
+  const __m256i Bias = _mm256_set1_epi64x(INT64_MIN);
+  size_t I = 0;
+  for (; I + 4 <= N; I += 4) {
+    __m256i A = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(Addrs + I));
+    __m256i In = _mm256_setzero_si256();
+    for (size_t J = 0; J < R; ++J) {
+      __m256i Off = _mm256_sub_epi64(A, _mm256_set1_epi64x(Begins[J]));
+      __m256i Size = _mm256_set1_epi64x(Sizes[J] ^ (uint64_t)INT64_MIN);
+      In = _mm256_or_si256(
+          In, _mm256_cmpgt_epi64(Size, _mm256_xor_si256(Off, Bias)));
+    }
+    int Mask = _mm256_movemask_pd(_mm256_castsi256_pd(In));
+    for (unsigned K = 0; K < 4; ++K)
+      Out[I + K] = (Mask >> K) & 1;
+  }
+  inAnyRangeScalar(Addrs + I, N - I, Begins, Sizes, R, Out + I);
+}
+
+__attribute__((target("sse4.2"))) static void
+inAnyRangeSSE42(const uint64_t *Addrs, size_t N, const uint64_t *Begins,
+                const uint64_t *Sizes, size_t R, uint8_t *Out) {
+  const __m128i Bias = _mm_set1_epi64x(INT64_MIN);
+  size_t I = 0;
+  for (; I + 2 <= N; I += 2) {
+    __m128i A = _mm_loadu_si128(reinterpret_cast<const __m128i *>(Addrs + I));
+    __m128i In = _mm_setzero_si128();
+    for (size_t J = 0; J < R; ++J) {
+      __m128i Off = _mm_sub_epi64(A, _mm_set1_epi64x(Begins[J]));
+      __m128i Size = _mm_set1_epi64x(Sizes[J] ^ (uint64_t)INT64_MIN);
+      In = _mm_or_si128(In, _mm_cmpgt_epi64(Size, _mm_xor_si128(Off, Bias)));
+    }
+    int Mask = _mm_movemask_pd(_mm_castsi128_pd(In));
+    Out[I] = Mask & 1;
+    Out[I + 1] = (Mask >> 1) & 1;
+  }
+  inAnyRangeScalar(Addrs + I, N - I, Begins, Sizes, R, Out + I);
+}
+#endif
+
+bool isClassifyKernelSupported(ClassifyKernel K) {
+  switch (K) {
+  case ClassifyKernel::Scalar:
+    return true;
+#ifdef HAL_BYPASS_X86_SIMD
+  case ClassifyKernel::SSE42:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+  case ClassifyKernel::AVX2:
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+  case ClassifyKernel::SSE42:
+  case ClassifyKernel::AVX2:
+    return false;
+#endif
+  }
+  llvm_unreachable("Unknown classify kernel");
+}
+
+static InAnyRangeFn getKernel(ClassifyKernel K) {
+  assert(isClassifyKernelSupported(K) && "Kernel not supported by the host");
+  switch (K) {
+#ifdef HAL_BYPASS_X86_SIMD
+  case ClassifyKernel::SSE42:
+    return &inAnyRangeSSE42;
+  case ClassifyKernel::AVX2:
+    return &inAnyRangeAVX2;
+#endif
+  default:
+    return &inAnyRangeScalar;
+  }
+}
+
+static InAnyRangeFn selectKernel() {
+  for (ClassifyKernel K : {ClassifyKernel::AVX2, ClassifyKernel::SSE42})
+    if (isClassifyKernelSupported(K))
+      return getKernel(K);
+  return &inAnyRangeScalar;
+}
+
+void inAnyRange(ClassifyKernel K, ArrayRef<uint64_t> Addrs,
+                ArrayRef<uint64_t> Begins, ArrayRef<uint64_t> Sizes,
+                MutableArrayRef<uint8_t> Out) {
+  assert(Addrs.size() == Out.size() && Begins.size() == Sizes.size() &&
+         "Table size mismatch");
+  getKernel(K)(Addrs.data(), Addrs.size(), Begins.data(), Sizes.data(),
+               Begins.size(), Out.data());
+}
+
+void AddressClassifier::classify(ArrayRef<uint64_t> Addrs,
+                                 MutableArrayRef<uint8_t> Verdicts) const {
+  assert(Addrs.size() == Verdicts.size() && "Verdict table size mismatch");
+  static const InAnyRangeFn InAnyRange = selectKernel();
+  size_t N = Addrs.size();
+
+  // Inside the MMIO ranges of the profile...
+  if (HasMMIORanges)
+    InAnyRange(Addrs.data(), N, MMIOBegins.data(), MMIOSizes.data(),
+               MMIOBegins.size(), Verdicts.data());
+  else
+    std::memset(Verdicts.data(), 1, N);
+
+  // ...and outside of every memory region
+  if (MemoryBegins.empty())
+    return;
+  std::vector<uint8_t> InMemory(N);
+  InAnyRange(Addrs.data(), N, MemoryBegins.data(), MemorySizes.data(),
+             MemoryBegins.size(), InMemory.data());
+  for (size_t I = 0; I < N; ++I)
+    Verdicts[I] &= !InMemory[I];
+}
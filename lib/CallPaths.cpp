@@ -0,0 +1,123 @@
+//==============================================================================
+// FILE:
+//    CallPaths.cpp
+//
+// DESCRIPTION:
+//    Call graph reachability with shortest call paths, see CallPaths.h.
+//
+// License: MIT
+//==============================================================================
+#include "CallPaths.h"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include <algorithm>
+
+using namespace llvm;
+
+static cl::list<std::string>
+    ISRNames("isr", cl::desc("Additional interrupt handlers"),
+             cl::value_desc("function"), cl::CommaSeparated, cl::ZeroOrMore);
+
+CallPaths::CallPaths(const CallGraph &CG, ArrayRef<const Function *> Roots) {
+  for (const Function *R : Roots)
+    if (R && Parent.try_emplace(R, nullptr).second)
+      Order.push_back(R);
+
+  for (size_t I = 0; I < Order.size(); ++I) {
+    const CallGraphNode *N = CG[Order[I]];
+    for (const auto &CR : *N) {
+      const Function *Callee = CR.second->getFunction();
+      if (Callee && Parent.try_emplace(Callee, Order[I]).second)
+        Order.push_back(Callee);
+    }
+  }
+}
+
+std::vector<const Function *> CallPaths::getPath(const Function *F) const {
+  std::vector<const Function *> Path;
+  if (!reaches(F))
+    return Path;
+  for (; F; F = Parent.lookup(F))
+    Path.push_back(F);
+  std::reverse(Path.begin(), Path.end());
+  return Path;
+}
+
+unsigned CallPaths::getDepth(const Function *F) const {
+  unsigned Depth = 0;
+  for (F = Parent.lookup(F); F; F = Parent.lookup(F))
+    ++Depth;
+  return Depth;
+}
+
+std::vector<const Function *> getGlobalCtors(const Module &M) {
+  std::vector<std::pair<uint64_t, const Function *>> Ctors;
+  const GlobalVariable *GV = M.getNamedGlobal("llvm.global_ctors");
+  if (GV && GV->hasInitializer())
+    if (auto *Init = dyn_cast<ConstantArray>(GV->getInitializer()))
+      for (const Use &U : Init->operands()) {
+        // { i32 priority, void ()* ctor, i8* data }
+        auto *Entry = dyn_cast<ConstantStruct>(U.get());
+        if (!Entry || Entry->getNumOperands() < 2)
+          continue;
+        auto *Prio = dyn_cast<ConstantInt>(Entry->getOperand(0));
+        auto *Ctor =
+            dyn_cast<Function>(Entry->getOperand(1)->stripPointerCasts());
+        if (Prio && Ctor)
+          Ctors.push_back({Prio->getZExtValue(), Ctor});
+      }
+  std::stable_sort(Ctors.begin(), Ctors.end(),
+                   [](const std::pair<uint64_t, const Function *> &A,
+                      const std::pair<uint64_t, const Function *> &B) {
+                     return A.first < B.first;
+                   });
+
+  std::vector<const Function *> Res;
+  for (const auto &C : Ctors)
+    Res.push_back(C.second);
+  return Res;
+}
+
+bool isISR(const Function &F) {
+  StringRef Name = F.getName();
+  if (Name.endswith("IRQHandler") || Name.endswith("_isr") ||
+      F.hasFnAttribute("interrupt"))
+    return true;
+  return std::find(ISRNames.begin(), ISRNames.end(), Name) != ISRNames.end();
+}
+
+std::vector<const Function *> getISRs(const Module &M) {
+  std::vector<const Function *> Res;
+  for (const Function &F : M)
+    if (!F.isDeclaration() && isISR(F))
+      Res.push_back(&F);
+  return Res;
+}
+
+std::vector<const Function *> getAppRoots(const Module &M) {
+  std::vector<const Function *> Res;
+  const Function *Main = M.getFunction("main");
+  if (Main && !Main->isDeclaration())
+    Res.push_back(Main);
+  for (const char *Create : {"xTaskCreate", "xTaskCreateStatic"}) {
+    const Function *F = M.getFunction(Create);
+    if (!F)
+      continue;
+    for (const User *U : F->users()) {
+      auto *Call = dyn_cast<CallBase>(U);
+      if (!Call || Call->getCalledFunction() != F || Call->arg_size() == 0)
+        continue;
+      auto *Task =
+          dyn_cast<Function>(Call->getArgOperand(0)->stripPointerCasts());
+      if (Task && !Task->isDeclaration() &&
+          std::find(Res.begin(), Res.end(), Task) == Res.end())
+        Res.push_back(Task);
+    }
+  }
+  std::vector<const Function *> ISRs = getISRs(M);
+  Res.insert(Res.end(), ISRs.begin(), ISRs.end());
+  return Res;
+}
@@ -0,0 +1,143 @@
+//==============================================================================
+// FILE:
+//    ChangeScope.cpp
+//
+// DESCRIPTION:
+//    Computes the functions touched by a change (ChangeScope). A function is
+//    changed if the DIFile of its DISubprogram is one of the changed files;
+//    paths from git are relative to the repository root and match the end of
+//    the (absolute) debug info path. Callers and callees are found through
+//    the uses of the changed functions and their call instructions, so that
+//    no call graph of the whole module has to be built.
+//
+// License: MIT
+//==============================================================================
+#include "ChangeScope.h"
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+
+using namespace llvm;
+
+static cl::list<std::string>
+    ChangedFiles("changed-files",
+                 cl::desc("Only scan the functions defined in these source "
+                          "files, and their direct callers and callees"),
+                 cl::value_desc("file"), cl::CommaSeparated, cl::ZeroOrMore);
+
+static cl::opt<bool> ChangedFromGit(
+    "changed-from-git",
+    cl::desc("Same as -changed-files, with the files reported by "
+             "`git diff --name-only HEAD`"),
+    cl::init(false));
+
+//------------------------------------------------------------------------------
+// Changed files
+//------------------------------------------------------------------------------
+Expected<std::vector<std::string>> getGitChangedFiles() {
+  ErrorOr<std::string> Git = sys::findProgramByName("git");
+  if (!Git)
+    return createStringError(Git.getError(), "cannot find git");
+
+  SmallString<128> OutPath;
+  if (std::error_code EC =
+          sys::fs::createTemporaryFile("changed-files", "txt", OutPath))
+    return createStringError(EC, "cannot create a temporary file");
+  FileRemover RemoveOut(OutPath);
+
+  StringRef Args[] = {"git", "diff", "--name-only", "HEAD"};
+  // stdin and stderr go to /dev/null
+  Optional<StringRef> Redirects[] = {StringRef(""), StringRef(OutPath),
+                                     StringRef("")};
+  std::string ErrMsg;
+  int RC = sys::ExecuteAndWait(*Git, Args, None, Redirects,
+                               /*SecondsToWait=*/0, /*MemoryLimit=*/0,
+                               &ErrMsg);
+  if (RC != 0)
+    return createStringError(inconvertibleErrorCode(),
+                             "git diff failed (%d)%s%s", RC,
+                             ErrMsg.empty() ? ", not in a repository?" : ": ",
+                             ErrMsg.c_str());
+
+  auto Buf = MemoryBuffer::getFile(OutPath);
+  if (!Buf)
+    return createStringError(Buf.getError(), "cannot read the git output");
+  std::vector<std::string> Files;
+  SmallVector<StringRef, 16> Lines;
+  (*Buf)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef Line : Lines)
+    if (!Line.trim().empty())
+      Files.push_back(Line.trim().str());
+  return Files;
+}
+
+bool isSameSourceFile(StringRef Path, StringRef Changed) {
+  SmallString<128> P(Path), C(Changed);
+  sys::path::remove_dots(P, /*remove_dot_dot=*/true);
+  sys::path::remove_dots(C, /*remove_dot_dot=*/true);
+  if (P == C)
+    return true;
+  if (sys::path::is_absolute(C) || !P.endswith(C))
+    return false;
+  // "src/Spi.cpp" matches "/proj/src/Spi.cpp" but not "/proj/mysrc/Spi.cpp"
+  return sys::path::is_separator(P[P.size() - C.size() - 1]);
+}
+
+//------------------------------------------------------------------------------
+// ChangeScope
+//------------------------------------------------------------------------------
+void ChangeScope::configure(const Module &M) {
+  std::vector<std::string> Files(ChangedFiles.begin(), ChangedFiles.end());
+  if (ChangedFromGit) {
+    Expected<std::vector<std::string>> GitFiles = getGitChangedFiles();
+    if (!GitFiles) {
+      logAllUnhandledErrors(GitFiles.takeError(), errs(),
+                            "-changed-from-git: ");
+      errs() << "-changed-from-git: scanning the whole module\n";
+      return;
+    }
+    Files.insert(Files.end(), GitFiles->begin(), GitFiles->end());
+  } else if (ChangedFiles.empty()) {
+    return;
+  }
+  Enabled = true;
+
+  // 1. The functions defined in the changed files
+  DenseMap<const DIFile *, bool> IsChanged;
+  std::vector<const Function *> Changed;
+  for (const Function &F : M) {
+    const DISubprogram *SP = F.getSubprogram();
+    if (F.isDeclaration() || !SP || !SP->getFile())
+      continue;
+    auto It = IsChanged.try_emplace(SP->getFile(), false);
+    if (It.second) {
+      SmallString<128> Path(SP->getFilename());
+      sys::fs::make_absolute(SP->getDirectory(), Path);
+      for (const std::string &File : Files)
+        It.first->second |= isSameSourceFile(Path, File);
+    }
+    if (It.first->second)
+      Changed.push_back(&F);
+  }
+
+  // 2. Their direct callers and callees
+  for (const Function *F : Changed) {
+    Scope.insert(F);
+    for (const User *U : F->users())
+      if (auto *Call = dyn_cast<CallBase>(U))
+        Scope.insert(Call->getFunction());
+    for (const Instruction &I : instructions(F))
+      if (auto *Call = dyn_cast<CallBase>(&I))
+        if (const Function *Callee = Call->getCalledFunction())
+          Scope.insert(Callee);
+  }
+}
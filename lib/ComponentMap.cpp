@@ -0,0 +1,207 @@
+//==============================================================================
+// FILE:
+//    ComponentMap.cpp
+//
+// DESCRIPTION:
+//    Builds a source file -> build component (CMake target) table.
+//
+//    compile_commands.json doesn't name targets explicitly, but CMake places
+//    every object file under "CMakeFiles/<target>.dir/", so the target is
+//    recovered from the output path of each compile command. The CMake
+//    file-API reply lists the sources of every target directly.
+//
+//    The table is built once; afterwards, every lookup is a single hash
+//    lookup on the normalized path.
+//
+// License: MIT
+//==============================================================================
+#include "ComponentMap.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/StringSaver.h"
+
+using namespace llvm;
+
+std::string normalizePath(StringRef Dir, StringRef File) {
+  SmallString<256> Path;
+  if (sys::path::is_absolute(File) || Dir.empty())
+    Path = File;
+  else
+    sys::path::append(Path, Dir, File);
+  sys::path::remove_dots(Path, /*remove_dot_dot=*/true);
+  return std::string(Path.str());
+}
+
+static Expected<json::Value> readJSON(StringRef Path) {
+  auto Buf = MemoryBuffer::getFile(Path);
+  if (!Buf)
+    return createStringError(Buf.getError(), "cannot read '%s'",
+                             Path.str().c_str());
+  return json::parse((*Buf)->getBuffer());
+}
+
+StringRef ComponentMap::getTargetFromObjectPath(StringRef Output) {
+  // Archive members, "libfoo.a(bar.o)"
+  size_t Paren = Output.find(".a(");
+  if (Paren != StringRef::npos) {
+    StringRef Archive = sys::path::filename(Output.take_front(Paren));
+    Archive.consume_front("lib");
+    return Archive;
+  }
+
+  for (auto It = sys::path::begin(Output), E = sys::path::end(Output); It != E;
+       ++It) {
+    if (*It != "CMakeFiles")
+      continue;
+    if (++It == E)
+      break;
+    if (It->endswith(".dir"))
+      return It->drop_back(4);
+  }
+  return StringRef();
+}
+
+unsigned ComponentMap::getOrAddComponent(StringRef Name) {
+  auto Ins = ComponentIds.try_emplace(Name, Components.size());
+  if (Ins.second)
+    Components.push_back(Name.str());
+  return Ins.first->second;
+}
+
+void ComponentMap::addFile(StringRef Dir, StringRef File, unsigned Component) {
+  // The first target that compiles a file wins
+  Files.try_emplace(normalizePath(Dir, File), Component);
+}
+
+unsigned ComponentMap::lookup(StringRef File) const {
+  auto It = Files.find(File);
+  return It == Files.end() ? None : It->second;
+}
+
+Error ComponentMap::loadCompileCommands(StringRef Path) {
+  Expected<json::Value> DB = readJSON(Path);
+  if (!DB)
+    return DB.takeError();
+  const json::Array *Commands = DB->getAsArray();
+  if (!Commands)
+    return createStringError(inconvertibleErrorCode(),
+                             "'%s' is not a compilation database",
+                             Path.str().c_str());
+
+  BumpPtrAllocator Alloc;
+  StringSaver Saver(Alloc);
+  for (const json::Value &V : *Commands) {
+    const json::Object *Cmd = V.getAsObject();
+    if (!Cmd)
+      continue;
+    StringRef Dir = Cmd->getString("directory").getValueOr("");
+    Optional<StringRef> File = Cmd->getString("file");
+    if (!File)
+      continue;
+
+    // Newer CMake versions record the object file, older ones only the
+    // command line.
+    StringRef Output = Cmd->getString("output").getValueOr("");
+    if (Output.empty()) {
+      SmallVector<const char *, 64> Args;
+      if (const json::Array *A = Cmd->getArray("arguments")) {
+        for (const json::Value &Arg : *A)
+          if (Optional<StringRef> S = Arg.getAsString())
+            Args.push_back(Saver.save(*S).data());
+      } else if (Optional<StringRef> C = Cmd->getString("command")) {
+        cl::TokenizeGNUCommandLine(*C, Saver, Args);
+      }
+      for (size_t I = 0; I + 1 < Args.size(); ++I)
+        if (StringRef(Args[I]) == "-o")
+          Output = Args[I + 1];
+    }
+
+    StringRef Target = getTargetFromObjectPath(Output);
+    if (!Target.empty())
+      addFile(Dir, *File, getOrAddComponent(Target));
+  }
+  return Error::success();
+}
+
+Error ComponentMap::loadFileAPIReply(StringRef ReplyDir) {
+  // The most recent index file sorts last
+  std::string Index;
+  std::error_code EC;
+  for (sys::fs::directory_iterator It(ReplyDir, EC), E; It != E && !EC;
+       It.increment(EC)) {
+    StringRef Name = sys::path::filename(It->path());
+    if (Name.startswith("index-") && Name.endswith(".json") &&
+        It->path() > Index)
+      Index = It->path();
+  }
+  if (EC || Index.empty())
+    return createStringError(inconvertibleErrorCode(),
+                             "no CMake file-API index in '%s'",
+                             ReplyDir.str().c_str());
+
+  Expected<json::Value> IndexJSON = readJSON(Index);
+  if (!IndexJSON)
+    return IndexJSON.takeError();
+  const json::Object *IndexObj = IndexJSON->getAsObject();
+  const json::Array *Objects =
+      IndexObj ? IndexObj->getArray("objects") : nullptr;
+  if (!Objects)
+    return createStringError(inconvertibleErrorCode(), "malformed '%s'",
+                             Index.c_str());
+
+  for (const json::Value &O : *Objects) {
+    const json::Object *Obj = O.getAsObject();
+    if (!Obj || Obj->getString("kind") != StringRef("codemodel"))
+      continue;
+    SmallString<256> CodeModelPath(ReplyDir);
+    sys::path::append(CodeModelPath,
+                      Obj->getString("jsonFile").getValueOr(""));
+    Expected<json::Value> CodeModel = readJSON(CodeModelPath);
+    if (!CodeModel)
+      return CodeModel.takeError();
+    const json::Object *CM = CodeModel->getAsObject();
+    if (!CM)
+      continue;
+
+    StringRef SourceDir;
+    if (const json::Object *Paths = CM->getObject("paths"))
+      SourceDir = Paths->getString("source").getValueOr("");
+    const json::Array *Configs = CM->getArray("configurations");
+    if (!Configs)
+      continue;
+    for (const json::Value &C : *Configs) {
+      const json::Object *Config = C.getAsObject();
+      const json::Array *Targets = Config ? Config->getArray("targets") : nullptr;
+      if (!Targets)
+        continue;
+      for (const json::Value &T : *Targets) {
+        const json::Object *TargetRef = T.getAsObject();
+        if (!TargetRef)
+          continue;
+        SmallString<256> TargetPath(ReplyDir);
+        sys::path::append(TargetPath,
+                          TargetRef->getString("jsonFile").getValueOr(""));
+        Expected<json::Value> TargetJSON = readJSON(TargetPath);
+        if (!TargetJSON)
+          return TargetJSON.takeError();
+        const json::Object *Target = TargetJSON->getAsObject();
+        const json::Array *Sources =
+            Target ? Target->getArray("sources") : nullptr;
+        if (!Sources)
+          continue;
+        unsigned Id =
+            getOrAddComponent(Target->getString("name").getValueOr(""));
+        for (const json::Value &S : *Sources)
+          if (const json::Object *Src = S.getAsObject())
+            if (Optional<StringRef> P = Src->getString("path"))
+              addFile(SourceDir, *P, Id);
+      }
+    }
+  }
+  return Error::success();
+}
@@ -0,0 +1,133 @@
+//==============================================================================
+// FILE:
+//    CostModel.cpp
+//
+// DESCRIPTION:
+//    Static time estimate of the hardware interaction of a function, see
+//    CostModel.h.
+//
+// License: MIT
+//==============================================================================
+#include "CostModel.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Support/CommandLine.h"
+
+using namespace llvm;
+
+static cl::opt<double> CPUMHz("cpu-mhz",
+                              cl::desc("Core clock used by the cost model"),
+                              cl::init(64));
+
+static cl::opt<double>
+    PollCostUs("poll-cost-us",
+               cl::desc("Estimated time spent in a polling loop (us)"),
+               cl::init(100));
+
+static cl::opt<double>
+    TickRateHz("tick-rate-hz",
+               cl::desc("RTOS tick rate, for delays given in ticks"),
+               cl::init(1000));
+
+double FunctionCost::getDelayUs() const {
+  double Us = 0;
+  for (const auto &D : Delays)
+    Us += D.second;
+  return Us;
+}
+
+double FunctionCost::getEstimatedUs() const {
+  return CostModel::estimateUs(Instructions, Polls.size(), getDelayUs());
+}
+
+double CostModel::estimateUs(unsigned Instructions, size_t Polls,
+                             double DelayUs) {
+  return Instructions / CPUMHz + Polls * PollCostUs + DelayUs;
+}
+
+Optional<double> CostModel::getDelayUs(const CallBase &Call) {
+  const Function *Callee = Call.getCalledFunction();
+  if (!Callee || Call.arg_size() == 0)
+    return None;
+  // us per unit of the first argument, -1 for RTOS ticks
+  double Unit = StringSwitch<double>(Callee->getName())
+                    .Cases("nrf_delay_us", "k_busy_wait", "k_usleep", 1)
+                    .Cases("delayMicroseconds", "HAL_DelayUs", 1)
+                    .Cases("nrf_delay_ms", "HAL_Delay", "k_msleep", 1000)
+                    .Cases("delay", "osDelay_ms", 1000)
+                    .Cases("vTaskDelay", "osDelay", "k_sleep_ticks", -1)
+                    .Default(0);
+  if (Unit == 0)
+    return None;
+  auto *Arg = dyn_cast<ConstantInt>(Call.getArgOperand(0));
+  if (!Arg)
+    return 0.0;
+  double N = Arg->getZExtValue();
+  return Unit < 0 ? N * 1e6 / TickRateHz : N * Unit;
+}
+
+const Instruction *CostModel::findPolledRead(const Value *V) const {
+  SmallVector<const Value *, 8> Worklist{V};
+  SmallPtrSet<const Value *, 16> Visited;
+  while (!Worklist.empty() && Visited.size() < 32) {
+    auto *I = dyn_cast<Instruction>(Worklist.pop_back_val());
+    if (!I || !Visited.insert(I).second)
+      continue;
+    if (isa<LoadInst>(I)) {
+      if (Sites.getSite(I))
+        return I;
+      continue;
+    }
+    if (auto *Call = dyn_cast<CallBase>(I)) {
+      // A getter that reads a register, e.g. nrf_gpio_pin_read()
+      const Function *Callee = Call->getCalledFunction();
+      if (Callee && !Callee->getReturnType()->isVoidTy())
+        for (const MMIOSite &S : Sites.getSites(Callee))
+          if (S.isLoad())
+            return I;
+      continue;
+    }
+    for (const Value *Op : I->operands())
+      Worklist.push_back(Op);
+  }
+  return nullptr;
+}
+
+const FunctionCost &CostModel::getCost(const Function &F) {
+  std::unique_ptr<FunctionCost> &Cost = Costs[&F];
+  if (Cost)
+    return *Cost;
+  Cost = std::make_unique<FunctionCost>();
+  if (F.isDeclaration())
+    return *Cost;
+
+  for (const Instruction &I : instructions(F)) {
+    ++Cost->Instructions;
+    if (auto *Call = dyn_cast<CallBase>(&I))
+      if (Optional<double> Us = getDelayUs(*Call))
+        Cost->Delays.push_back({Call, *Us});
+  }
+
+  // The analyses below need a non-const function, but don't modify it
+  Function &MutF = const_cast<Function &>(F);
+  DominatorTree DT(MutF);
+  LoopInfo LI(DT);
+  for (const Loop *L : LI.getLoopsInPreorder()) {
+    SmallVector<BasicBlock *, 4> Exiting;
+    L->getExitingBlocks(Exiting);
+    for (const BasicBlock *BB : Exiting) {
+      auto *Br = dyn_cast<BranchInst>(BB->getTerminator());
+      if (!Br || !Br->isConditional())
+        continue;
+      if (const Instruction *Read = findPolledRead(Br->getCondition())) {
+        Cost->Polls.push_back(Read);
+        break;
+      }
+    }
+  }
+  return *Cost;
+}
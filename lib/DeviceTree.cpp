@@ -0,0 +1,253 @@
+//==============================================================================
+// FILE:
+//    DeviceTree.cpp
+//
+// DESCRIPTION:
+//    Reads peripheral address ranges from a devicetree, either
+//      * a flattened devicetree source (`dtc -I dtb -O dts`, or Zephyr's
+//        zephyr.dts), or
+//      * Zephyr's generated devicetree_generated.h.
+//
+//    Every node with a `reg` property becomes a region named after its node
+//    label (e.g. "&spi0"), or its node name if it has no label. Memory nodes
+//    (memory@, sram@, flash@) become Region::Memory, everything else
+//    Region::Peripheral. Address translation through `ranges` is not
+//    supported: SoC nodes on MCUs use an identity mapping.
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+
+// "flash@0" -> Memory, "spi@40003000" -> Peripheral
+static Region::KindTy getRegionKind(StringRef NodeName) {
+  StringRef Base = NodeName.take_until([](char C) { return C == '@'; });
+  if (Base == "memory" || Base == "sram" || Base == "flash")
+    return Region::Memory;
+  return Region::Peripheral;
+}
+
+//------------------------------------------------------------------------------
+// Devicetree source
+//------------------------------------------------------------------------------
+// Removes // and /* */ comments, keeping string literals intact
+static std::string stripDTSComments(StringRef Text) {
+  std::string Res;
+  Res.reserve(Text.size());
+  for (size_t I = 0; I < Text.size(); ++I) {
+    if (Text[I] == '"') {
+      size_t End = Text.find('"', I + 1);
+      End = End == StringRef::npos ? Text.size() : End + 1;
+      Res += Text.slice(I, End).str();
+      I = End - 1;
+    } else if (Text.substr(I).startswith("//")) {
+      I = std::min(Text.find('\n', I), Text.size()) - 1;
+    } else if (Text.substr(I).startswith("/*")) {
+      size_t End = Text.find("*/", I + 2);
+      I = End == StringRef::npos ? Text.size() : End + 1;
+      Res += ' ';
+    } else {
+      Res += Text[I];
+    }
+  }
+  return Res;
+}
+
+// Parses the cells of "<0x40003000 0x1000>, <...>"
+static bool parseCells(StringRef Value, SmallVectorImpl<uint64_t> &Cells) {
+  for (;;) {
+    Value = Value.ltrim(" \t\n,");
+    if (Value.empty())
+      return true;
+    if (!Value.consume_front("<"))
+      return false;
+    StringRef Group = Value.take_until([](char C) { return C == '>'; });
+    Value = Value.drop_front(std::min(Group.size() + 1, Value.size()));
+    SmallVector<StringRef, 8> Tokens;
+    Group.split(Tokens, ' ', -1, /*KeepEmpty=*/false);
+    for (StringRef Tok : Tokens) {
+      uint64_t Cell;
+      if (Tok.trim().getAsInteger(0, Cell))
+        return false;
+      Cells.push_back(Cell);
+    }
+  }
+}
+
+static Error loadDTS(StringRef Path, StringRef Text, RegionTable &Regions) {
+  struct Node {
+    StringRef Name;
+    // "&label", or the node name if it has no label
+    std::string DisplayName;
+    // Cell sizes for the reg properties of the children of this node
+    unsigned AddrCells = 2;
+    unsigned SizeCells = 1;
+  };
+  SmallVector<Node, 8> Stack;
+
+  std::string Source = stripDTSComments(Text);
+  StringRef Cur(Source);
+  while (!(Cur = Cur.ltrim()).empty()) {
+    // Read up to the next '{', '}' or ';' outside of string literals
+    size_t I = 0;
+    bool InString = false;
+    for (; I < Cur.size(); ++I) {
+      char C = Cur[I];
+      if (C == '"')
+        InString = !InString;
+      else if (!InString && (C == '{' || C == '}' || C == ';'))
+        break;
+    }
+    if (I == Cur.size())
+      break;
+    StringRef Stmt = Cur.take_front(I).trim();
+    char Term = Cur[I];
+    Cur = Cur.drop_front(I + 1);
+
+    if (Term == '{') {
+      // [label: ...] name {
+      SmallVector<StringRef, 4> Parts;
+      Stmt.split(Parts, ' ', -1, /*KeepEmpty=*/false);
+      Node N;
+      N.Name = Parts.empty() ? StringRef() : Parts.back();
+      N.DisplayName = N.Name.str();
+      for (StringRef P : Parts)
+        if (P.endswith(":")) {
+          N.DisplayName = ("&" + P.drop_back()).str();
+          break;
+        }
+      Stack.push_back(std::move(N));
+      continue;
+    }
+    if (Term == '}') {
+      if (!Stack.empty())
+        Stack.pop_back();
+      continue;
+    }
+
+    // prop = value; (or "/dts-v1/;", "prop;" ...)
+    if (Stack.empty())
+      continue;
+    size_t Eq = Stmt.find('=');
+    if (Eq == StringRef::npos)
+      continue;
+    StringRef Prop = Stmt.take_front(Eq).trim();
+    StringRef Value = Stmt.drop_front(Eq + 1).trim();
+    SmallVector<uint64_t, 8> Cells;
+
+    if (Prop == "#address-cells" || Prop == "#size-cells") {
+      if (!parseCells(Value, Cells) || Cells.size() != 1)
+        continue;
+      (Prop == "#address-cells" ? Stack.back().AddrCells
+                                : Stack.back().SizeCells) = Cells[0];
+      continue;
+    }
+    if (Prop != "reg" || Stack.size() < 2)
+      continue;
+
+    const Node &Parent = Stack[Stack.size() - 2];
+    unsigned Stride = Parent.AddrCells + Parent.SizeCells;
+    if (!parseCells(Value, Cells) || Stride == 0 || Cells.size() % Stride ||
+        Parent.AddrCells > 2 || Parent.SizeCells > 2)
+      return createStringError(inconvertibleErrorCode(),
+                               "%s: malformed reg in node '%s'",
+                               Path.str().c_str(),
+                               Stack.back().Name.str().c_str());
+
+    const Node &N = Stack.back();
+    for (size_t I = 0; I < Cells.size(); I += Stride) {
+      uint64_t Addr = 0, Size = 0;
+      for (unsigned J = 0; J < Parent.AddrCells; ++J)
+        Addr = (Addr << 32) | Cells[I + J];
+      for (unsigned J = 0; J < Parent.SizeCells; ++J)
+        Size = (Size << 32) | Cells[I + Parent.AddrCells + J];
+      if (Size)
+        Regions.add({Addr, Addr + Size, N.DisplayName, getRegionKind(N.Name)});
+    }
+  }
+  return Error::success();
+}
+
+//------------------------------------------------------------------------------
+// Zephyr devicetree_generated.h
+//------------------------------------------------------------------------------
+//   #define DT_N_S_soc_S_spi_40003000_REG_IDX_0_VAL_ADDRESS 1073754112 /*...*/
+//   #define DT_N_S_soc_S_spi_40003000_REG_IDX_0_VAL_SIZE 4096 /* 0x1000 */
+//   #define DT_N_NODELABEL_spi0 DT_N_S_soc_S_spi_40003000
+static Error loadZephyrHeader(StringRef Text, RegionTable &Regions) {
+  struct Reg {
+    uint64_t Addr = 0, Size = 0;
+  };
+  // Node identifier -> reg entries (by index)
+  StringMap<SmallVector<Reg, 1>> Nodes;
+  StringMap<std::string> Labels;
+
+  SmallVector<StringRef, 0> Lines;
+  Text.split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef Line : Lines) {
+    if (!Line.consume_front("#define "))
+      continue;
+    StringRef Macro, Value;
+    std::tie(Macro, Value) = Line.split(' ');
+    Value = Value.take_until([](char C) { return C == ' '; });
+
+    if (Macro.consume_front("DT_N_NODELABEL_")) {
+      if (Value.startswith("DT_N_"))
+        Labels.try_emplace(Value, ("&" + Macro).str());
+      continue;
+    }
+
+    size_t Idx = Macro.find("_REG_IDX_");
+    if (Idx == StringRef::npos)
+      continue;
+    StringRef Node = Macro.take_front(Idx);
+    StringRef Rest = Macro.drop_front(Idx + 9);
+    unsigned RegIdx;
+    StringRef IdxStr = Rest.take_until([](char C) { return C == '_'; });
+    Rest = Rest.drop_front(IdxStr.size());
+    bool IsAddr = Rest == "_VAL_ADDRESS", IsSize = Rest == "_VAL_SIZE";
+    uint64_t Val;
+    if ((!IsAddr && !IsSize) || IdxStr.getAsInteger(10, RegIdx) ||
+        Value.getAsInteger(0, Val))
+      continue;
+
+    auto &Regs = Nodes[Node];
+    if (Regs.size() <= RegIdx)
+      Regs.resize(RegIdx + 1);
+    (IsAddr ? Regs[RegIdx].Addr : Regs[RegIdx].Size) = Val;
+  }
+
+  for (const auto &N : Nodes) {
+    // "DT_N_S_soc_S_spi_40003000" -> "spi_40003000"
+    StringRef Id = N.first();
+    size_t Last = Id.rfind("_S_");
+    StringRef NodeName = Last == StringRef::npos ? Id : Id.drop_front(Last + 3);
+    // "spi_40003000" -> "spi@40003000" for getRegionKind()
+    std::string DTSName = NodeName.str();
+    size_t Unit = NodeName.rfind('_');
+    if (Unit != StringRef::npos)
+      DTSName[Unit] = '@';
+
+    auto Label = Labels.find(Id);
+    std::string Name = Label != Labels.end() ? Label->second : DTSName;
+    for (const Reg &R : N.second)
+      if (R.Size)
+        Regions.add({R.Addr, R.Addr + R.Size, Name, getRegionKind(DTSName)});
+  }
+  return Error::success();
+}
+
+Error loadDeviceTree(StringRef Path, RegionTable &Regions) {
+  auto Buf = MemoryBuffer::getFile(Path);
+  if (!Buf)
+    return createStringError(Buf.getError(), "cannot read '%s'",
+                             Path.str().c_str());
+  if (sys::path::extension(Path) == ".h")
+    return loadZephyrHeader((*Buf)->getBuffer(), Regions);
+  return loadDTS(Path, (*Buf)->getBuffer(), Regions);
+}
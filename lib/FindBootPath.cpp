@@ -0,0 +1,344 @@
+//==============================================================================
+// FILE:
+//    FindBootPath.cpp
+//
+// DESCRIPTION:
+//    Boot critical path: the call path from the reset handler through main()
+//    to the call that starts the RTOS scheduler,
+//
+//      Reset_Handler -> main -> ... -> vTaskStartScheduler
+//
+//    Everything that functions on this path do before the path continues
+//    delays the start of the scheduler. This work is split into segments,
+//    one per call made on the way (including all its callees) plus one for
+//    the body of each path function, and each segment is annotated with its
+//    MMIO polling loops, fixed delays (nrf_delay_ms, vTaskDelay, ...) and
+//    the peripherals it writes to. Segments are ranked by their estimated
+//    cost (see CostModel.h). Helpers shared by several segments are counted
+//    in each of them.
+//
+//    When the reset handler is written in assembly (and thus not in the
+//    module), the functions it calls before main (-boot-pre-main, SystemInit
+//    by default) become segments of their own.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindBootPath.so `\`
+//        -passes="print<boot-path>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindBootPath.h"
+#include "CallPaths.h"
+#include "CostModel.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+#include <set>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+    BootEntry("boot-entry", cl::desc("Reset handler the boot path starts at"),
+              cl::init("Reset_Handler"));
+
+static cl::opt<std::string>
+    BootTarget("boot-target",
+               cl::desc("Function that ends the boot path"),
+               cl::init("vTaskStartScheduler"));
+
+static cl::list<std::string>
+    BootPreMain("boot-pre-main",
+                cl::desc("Functions called by the reset handler before main, "
+                         "if it isn't in the module (default: SystemInit)"),
+                cl::CommaSeparated, cl::ZeroOrMore);
+
+// Pretty-prints the result of this analysis
+static void printBootPathResult(llvm::raw_ostream &OutS,
+                                const FindBootPath::Result &);
+
+//------------------------------------------------------------------------------
+// FindBootPath Implementation
+//------------------------------------------------------------------------------
+namespace {
+// Accumulates the work of function bodies into a segment
+class SegmentBuilder {
+public:
+  SegmentBuilder(FindBootPath::Segment &Seg, const FindMMIOSites::Result &Sites,
+                 CostModel &Costs)
+      : Seg(Seg), Sites(Sites), Costs(Costs) {}
+
+  // Adds the body of F, or only the part that may run before Stop
+  void addBody(const Function &F, const Instruction *Stop = nullptr);
+  void finish() {
+    Seg.Peripherals.assign(Peripherals.begin(), Peripherals.end());
+    Seg.EstimatedUs = CostModel::estimateUs(Instructions, Seg.Polls.size(),
+                                            DelayUs);
+  }
+
+private:
+  FindBootPath::Segment &Seg;
+  const FindMMIOSites::Result &Sites;
+  CostModel &Costs;
+  unsigned Instructions = 0;
+  double DelayUs = 0;
+  std::set<std::string> Peripherals;
+};
+} // namespace
+
+// The blocks from which Stop may be reached again after having left it
+static SmallPtrSet<const BasicBlock *, 16>
+getBlocksBefore(const Instruction &Stop) {
+  SmallPtrSet<const BasicBlock *, 16> Before;
+  SmallVector<const BasicBlock *, 16> Worklist(pred_begin(Stop.getParent()),
+                                               pred_end(Stop.getParent()));
+  while (!Worklist.empty()) {
+    const BasicBlock *BB = Worklist.pop_back_val();
+    if (Before.insert(BB).second)
+      Worklist.append(pred_begin(BB), pred_end(BB));
+  }
+  return Before;
+}
+
+// True if I may run before Stop (always if there's no Stop). Before is
+// getBlocksBefore(*Stop).
+static bool runsBefore(const Instruction *I, const Instruction *Stop,
+                       const SmallPtrSetImpl<const BasicBlock *> &Before) {
+  if (!Stop || Before.count(I->getParent()))
+    return true;
+  return I->getParent() == Stop->getParent() && I->comesBefore(Stop);
+}
+
+void SegmentBuilder::addBody(const Function &F, const Instruction *Stop) {
+  SmallPtrSet<const BasicBlock *, 16> Before;
+  if (Stop)
+    Before = getBlocksBefore(*Stop);
+  for (const Instruction &I : instructions(F)) {
+    if (!runsBefore(&I, Stop, Before))
+      continue;
+    ++Instructions;
+    if (const MMIOSite *S = Sites.getSite(&I)) {
+      ++Seg.MMIOAccesses;
+      if (S->IsStore)
+        Peripherals.insert(Sites.getPeripheralName(*S));
+    }
+  }
+
+  const FunctionCost &Cost = Costs.getCost(F);
+  for (const Instruction *Poll : Cost.Polls)
+    if (runsBefore(Poll, Stop, Before))
+      Seg.Polls.push_back(Poll);
+  for (const auto &D : Cost.Delays)
+    if (runsBefore(D.first, Stop, Before)) {
+      Seg.Delays.push_back(D);
+      DelayUs += D.second;
+    }
+}
+
+FindBootPath::Result
+FindBootPath::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                          const CallGraph &CG) {
+  Result Res;
+  CostModel Costs(Sites);
+
+  auto GetDefined = [&M](StringRef Name) -> const Function * {
+    const Function *F = M.getFunction(Name);
+    return F && !F->isDeclaration() ? F : nullptr;
+  };
+  const Function *Entry = GetDefined(BootEntry);
+  const Function *Main = GetDefined("main");
+  const Function *Target = M.getFunction(BootTarget);
+
+  // 1. Entry -> main -> target
+  if (Entry) {
+    CallPaths ToMain(CG, Entry);
+    if (Main && ToMain.reaches(Main))
+      Res.Path = ToMain.getPath(Main);
+  }
+  if (Res.Path.empty() && (Main || Entry))
+    Res.Path.push_back(Main ? Main : Entry);
+  if (Res.Path.empty())
+    return Res;
+  if (Target) {
+    CallPaths ToTarget(CG, Res.Path.back());
+    std::vector<const Function *> Tail = ToTarget.getPath(Target);
+    if (Tail.size() > 1)
+      Res.Path.insert(Res.Path.end(), Tail.begin() + 1, Tail.end());
+  }
+
+  auto AddCallee = [&](const Function *Caller, const Function *Callee) {
+    Segment Seg{Caller, Callee};
+    SegmentBuilder Builder(Seg, Sites, Costs);
+    CallPaths Reachable(CG, Callee);
+    for (const Function *F : Reachable.functions())
+      if (!F->isDeclaration())
+        Builder.addBody(*F);
+    Builder.finish();
+    Res.Segments.push_back(std::move(Seg));
+  };
+
+  // 2. Code the (assembly) reset handler runs before main
+  if (Res.Path.front() != Entry) {
+    std::vector<std::string> PreMain(BootPreMain.begin(), BootPreMain.end());
+    if (PreMain.empty())
+      PreMain.push_back("SystemInit");
+    for (const std::string &Name : PreMain)
+      if (const Function *F = GetDefined(Name))
+        AddCallee(nullptr, F);
+  }
+
+  // 3. The work of every function on the path before the path continues
+  std::set<const Function *> OnPath(Res.Path.begin(), Res.Path.end());
+  for (size_t I = 0; I < Res.Path.size(); ++I) {
+    const Function *Caller = Res.Path[I];
+    if (Caller == Target || Caller->isDeclaration())
+      continue;
+    const Function *Next = I + 1 < Res.Path.size() ? Res.Path[I + 1] : nullptr;
+    const Instruction *Stop = nullptr;
+    for (const Instruction &Ins : instructions(Caller))
+      if (auto *Call = dyn_cast<CallBase>(&Ins))
+        if (Next && Call->getCalledFunction() == Next) {
+          Stop = Call;
+          break;
+        }
+
+    Segment Body{Caller, Caller};
+    SegmentBuilder Builder(Body, Sites, Costs);
+    Builder.addBody(*Caller, Stop);
+    Builder.finish();
+    Res.Segments.push_back(std::move(Body));
+
+    SmallPtrSet<const Function *, 16> Seen;
+    SmallPtrSet<const BasicBlock *, 16> Before;
+    if (Stop)
+      Before = getBlocksBefore(*Stop);
+    for (const Instruction &Ins : instructions(Caller)) {
+      auto *Call = dyn_cast<CallBase>(&Ins);
+      if (!Call)
+        continue;
+      const Function *Callee = Call->getCalledFunction();
+      if (!runsBefore(Call, Stop, Before) || !Callee || Callee->isDeclaration() ||
+          OnPath.count(Callee) || !Seen.insert(Callee).second)
+        continue;
+      AddCallee(Caller, Callee);
+    }
+  }
+
+  // 4. Rank the segments that talk to hardware
+  Res.Segments.erase(std::remove_if(Res.Segments.begin(), Res.Segments.end(),
+                                    [](const Segment &S) {
+                                      return !S.MMIOAccesses &&
+                                             S.Polls.empty() &&
+                                             S.Delays.empty();
+                                    }),
+                     Res.Segments.end());
+  std::stable_sort(Res.Segments.begin(), Res.Segments.end(),
+                   [](const Segment &A, const Segment &B) {
+                     return A.EstimatedUs > B.EstimatedUs;
+                   });
+  for (const Segment &S : Res.Segments)
+    Res.EstimatedUs += S.EstimatedUs;
+  return Res;
+}
+
+PreservedAnalyses FindBootPathPrinter::run(Module &M,
+                                           ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindBootPath>(M);
+
+  printBootPathResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindBootPath::Result FindBootPath::run(llvm::Module &M,
+                                       llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  return runOnModule(M, Sites, CG);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindBootPath::Key;
+
+llvm::PassPluginLibraryInfo getFindBootPathPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "boot-path", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<boot-path>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<boot-path>") {
+                    MPM.addPass(FindBootPathPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindBootPath>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindBootPath(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindBootPathPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printBootPathResult(raw_ostream &OutS,
+                                const FindBootPath::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Boot critical path\n";
+  OutS << "=================================================\n";
+  if (Res.Path.empty())
+    OutS << "No boot entry: neither " << BootEntry << " nor main";
+  for (size_t I = 0; I < Res.Path.size(); ++I)
+    OutS << (I ? " -> " : "") << Res.Path[I]->getName();
+  OutS << "\n";
+  for (const auto &S : Res.Segments) {
+    if (!S.Caller)
+      OutS << "<before main> -> " << S.Callee->getName();
+    else if (S.Caller == S.Callee)
+      OutS << S.Caller->getName() << " (body)";
+    else
+      OutS << S.Caller->getName() << " -> " << S.Callee->getName();
+    OutS << format(": ~%.1f us, %u MMIO, %zu polls, %zu delays\n",
+                   S.EstimatedUs, S.MMIOAccesses, S.Polls.size(),
+                   S.Delays.size());
+    if (!S.Peripherals.empty()) {
+      OutS << "    initializes";
+      for (const std::string &P : S.Peripherals)
+        OutS << " " << P;
+      OutS << "\n";
+    }
+    for (const Instruction *Poll : S.Polls)
+      OutS << "    poll in " << Poll->getFunction()->getName() << " at "
+           << getDebugLocString(Poll) << "\n";
+    for (const auto &D : S.Delays)
+      OutS << "    " << D.first->getCalledFunction()->getName()
+           << format(" (%.0f us) in ", D.second)
+           << D.first->getFunction()->getName() << " at "
+           << getDebugLocString(D.first) << "\n";
+  }
+  OutS << format("Total: ~%.1f us\n", Res.EstimatedUs);
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
@@ -0,0 +1,281 @@
+//==============================================================================
+// FILE:
+//    FindCriticalSections.cpp
+//
+// DESCRIPTION:
+//    Finds critical sections (code run with interrupts disabled) that access
+//    MMIO, directly or through callees, and estimates their length. Every
+//    interrupt that arrives meanwhile is delayed by that long.
+//
+//    A section starts at a call that disables interrupts (__disable_irq(),
+//    taskENTER_CRITICAL()/vPortEnterCritical(), portDISABLE_INTERRUPTS(),
+//    app_util_critical_region_enter(), __set_PRIMASK(1), `cpsid i`, ...)
+//    and extends along every path to the matching enable call, or to the
+//    return of the function. Its length is the number of instructions on
+//    those paths and in the functions called from them, plus the polling
+//    loops and delays they contain (see CostModel.h). Sections are reported
+//    longest first; busy-waits inside a section are flagged.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindCriticalSections.so `\`
+//        -passes="print<critical-sections>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindCriticalSections.h"
+#include "CallPaths.h"
+#include "CostModel.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+#include <set>
+
+using namespace llvm;
+
+// Pretty-prints the result of this analysis
+static void printCriticalSectionsResult(llvm::raw_ostream &OutS,
+                                        const FindCriticalSections::Result &);
+
+//------------------------------------------------------------------------------
+// FindCriticalSections Implementation
+//------------------------------------------------------------------------------
+enum class IRQEffect { None, Disable, Enable };
+
+static IRQEffect getIRQEffect(StringRef Name) {
+  return StringSwitch<IRQEffect>(Name)
+      .Cases("__disable_irq", "vPortEnterCritical", "vTaskEnterCritical",
+             IRQEffect::Disable)
+      .Cases("ulPortRaiseBASEPRI", "ulPortSetInterruptMask",
+             "app_util_critical_region_enter", "sd_nvic_critical_region_enter",
+             IRQEffect::Disable)
+      .Cases("irq_lock", "arch_irq_lock", "taskENTER_CRITICAL",
+             "portDISABLE_INTERRUPTS", IRQEffect::Disable)
+      .Cases("__enable_irq", "vPortExitCritical", "vTaskExitCritical",
+             IRQEffect::Enable)
+      .Cases("vPortSetBASEPRI", "vPortClearInterruptMask",
+             "app_util_critical_region_exit", "sd_nvic_critical_region_exit",
+             IRQEffect::Enable)
+      .Cases("irq_unlock", "arch_irq_unlock", "taskEXIT_CRITICAL",
+             "portENABLE_INTERRUPTS", IRQEffect::Enable)
+      .Default(IRQEffect::None);
+}
+
+// The effect of I on the interrupt mask
+static IRQEffect getIRQEffect(const Instruction &I) {
+  auto *Call = dyn_cast<CallBase>(&I);
+  if (!Call)
+    return IRQEffect::None;
+  if (auto *Asm = dyn_cast<InlineAsm>(Call->getCalledOperand())) {
+    StringRef Str = Asm->getAsmString();
+    if (Str.contains_insensitive("cpsid i"))
+      return IRQEffect::Disable;
+    if (Str.contains_insensitive("cpsie i"))
+      return IRQEffect::Enable;
+    return IRQEffect::None;
+  }
+  const Function *Callee = Call->getCalledFunction();
+  if (!Callee)
+    return IRQEffect::None;
+  // __set_PRIMASK(1) masks interrupts, anything else restores the mask
+  if (Callee->getName() == "__set_PRIMASK" && Call->arg_size() == 1) {
+    auto *Val = dyn_cast<ConstantInt>(Call->getArgOperand(0));
+    return Val && Val->isOne() ? IRQEffect::Disable : IRQEffect::Enable;
+  }
+  return getIRQEffect(Callee->getName());
+}
+
+FindCriticalSections::Result
+FindCriticalSections::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                                  const FindMMIOFunc::Result &MMIOFuncs,
+                                  const CallGraph &CG) {
+  Result Res;
+  CostModel Costs(Sites);
+
+  for (const Function &F : M) {
+    // The implementations of the primitives themselves
+    if (F.isDeclaration() || getIRQEffect(F.getName()) != IRQEffect::None ||
+        F.getName() == "__set_PRIMASK")
+      continue;
+    const FunctionCost &FuncCost = Costs.getCost(F);
+
+    for (const Instruction &Enter : instructions(F)) {
+      if (getIRQEffect(Enter) != IRQEffect::Disable)
+        continue;
+      Section S;
+      S.Func = &F;
+      S.Enter = &Enter;
+
+      // 1. The instructions in the section, up to the enable calls
+      SmallPtrSet<const Instruction *, 32> Inside;
+      SmallPtrSet<const BasicBlock *, 16> Visited;
+      SmallVector<const Instruction *, 8> Worklist{Enter.getNextNode()};
+      while (!Worklist.empty()) {
+        const Instruction *I = Worklist.pop_back_val();
+        for (; I; I = I->getNextNode()) {
+          if (getIRQEffect(*I) == IRQEffect::Enable) {
+            S.Exits.push_back(I);
+            break;
+          }
+          if (!Inside.insert(I).second)
+            break;
+          if (isa<ReturnInst>(I))
+            S.Unclosed = true;
+          if (!I->isTerminator())
+            continue;
+          for (const BasicBlock *Succ : successors(I->getParent()))
+            if (Visited.insert(Succ).second)
+              Worklist.push_back(&Succ->front());
+        }
+      }
+
+      // 2. Their cost, including the callees
+      std::set<const Function *> Callees;
+      for (const Instruction *I : Inside) {
+        ++S.Instructions;
+        if (Sites.getSite(I))
+          ++S.MMIOAccesses;
+        if (auto *Call = dyn_cast<CallBase>(I))
+          if (const Function *Callee = Call->getCalledFunction())
+            Callees.insert(Callee);
+      }
+      for (const Instruction *Poll : FuncCost.Polls)
+        if (Inside.count(Poll))
+          S.Polls.push_back(Poll);
+      for (const auto &D : FuncCost.Delays)
+        if (Inside.count(D.first))
+          S.Delays.push_back(D);
+
+      std::vector<const Function *> Roots(Callees.begin(), Callees.end());
+      CallPaths Reachable(CG, Roots);
+      for (const Function *Callee : Reachable.functions()) {
+        if (Callee->isDeclaration())
+          continue;
+        const FunctionCost &Cost = Costs.getCost(*Callee);
+        S.Instructions += Cost.Instructions;
+        S.MMIOAccesses += Sites.getSites(Callee).size();
+        S.Polls.insert(S.Polls.end(), Cost.Polls.begin(), Cost.Polls.end());
+        S.Delays.insert(S.Delays.end(), Cost.Delays.begin(), Cost.Delays.end());
+        if (MMIOFuncs.count(Callee))
+          S.Bypasses.push_back(Callee);
+      }
+      for (const Function *Callee : Roots)
+        if (!Callee->isDeclaration())
+          S.Callees.push_back(Callee);
+
+      if (!S.MMIOAccesses && S.Bypasses.empty())
+        continue;
+      double DelayUs = 0;
+      for (const auto &D : S.Delays)
+        DelayUs += D.second;
+      S.EstimatedUs =
+          CostModel::estimateUs(S.Instructions, S.Polls.size(), DelayUs);
+      Res.push_back(std::move(S));
+    }
+  }
+
+  std::stable_sort(Res.begin(), Res.end(),
+                   [](const Section &A, const Section &B) {
+                     return A.EstimatedUs > B.EstimatedUs;
+                   });
+  return Res;
+}
+
+PreservedAnalyses
+FindCriticalSectionsPrinter::run(Module &M, ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindCriticalSections>(M);
+
+  printCriticalSectionsResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindCriticalSections::Result
+FindCriticalSections::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &Funcs = MAM.getResult<FindMMIOFunc>(M);
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  return runOnModule(M, Sites, Funcs, CG);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindCriticalSections::Key;
+
+llvm::PassPluginLibraryInfo getFindCriticalSectionsPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "critical-sections", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<critical-sections>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<critical-sections>") {
+                    MPM.addPass(FindCriticalSectionsPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindCriticalSections>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindCriticalSections(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindCriticalSectionsPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printCriticalSectionsResult(raw_ostream &OutS,
+                                        const FindCriticalSections::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Critical sections accessing MMIO\n";
+  OutS << "=================================================\n";
+  for (const auto &S : Res) {
+    OutS << S.Func->getName() << " at " << getDebugLocString(S.Enter)
+         << format(": ~%.1f us, %u instructions, %u MMIO", S.EstimatedUs,
+                   S.Instructions, S.MMIOAccesses);
+    if (S.isBusyWait())
+      OutS << format(", BUSY-WAIT (%zu polls, %zu delays)", S.Polls.size(),
+                     S.Delays.size());
+    if (S.Unclosed)
+      OutS << ", returns with interrupts disabled";
+    OutS << "\n";
+    if (!S.Callees.empty()) {
+      OutS << "    calls";
+      for (const Function *Callee : S.Callees)
+        OutS << " " << Callee->getName();
+      OutS << "\n";
+    }
+    if (!S.Bypasses.empty()) {
+      OutS << "    HAL bypasses";
+      for (const Function *Bypass : S.Bypasses)
+        OutS << " " << Bypass->getName();
+      OutS << "\n";
+    }
+    for (const Instruction *Poll : S.Polls)
+      OutS << "    poll in " << Poll->getFunction()->getName() << " at "
+           << getDebugLocString(Poll) << "\n";
+  }
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
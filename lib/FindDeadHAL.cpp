@@ -0,0 +1,175 @@
+//==============================================================================
+// FILE:
+//    FindDeadHAL.cpp
+//
+// DESCRIPTION:
+//    Finds HAL functions that are never called while the application
+//    accesses the same registers directly: APIs that are implemented but
+//    ignored, and the clearest consolidation targets.
+//
+//    A HAL function is dead if no application root (main, RTOS tasks,
+//    ISRs) or static initializer reaches it in the call graph and its
+//    address is never taken. The reachability is the AppReachability
+//    analysis, which the pass manager caches for all the reports. The
+//    registers of the dead HAL functions are intersected with those of the
+//    bypasses by reusing the join made by FindHALCoverage. The result is
+//    ranked by the number of bypassed registers.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindDeadHAL.so `\`
+//        -passes="print<dead-hal>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindDeadHAL.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include <algorithm>
+
+using namespace llvm;
+
+// Pretty-prints the result of this analysis
+static void printDeadHALResult(llvm::raw_ostream &OutS,
+                               const FindMMIOSites::Result &Sites,
+                               const FindDeadHAL::Result &);
+
+//------------------------------------------------------------------------------
+// FindDeadHAL Implementation
+//------------------------------------------------------------------------------
+FindDeadHAL::Result
+FindDeadHAL::runOnModule(Module &M, const FindHALCoverage::Result &Coverage,
+                         const AppReachability::Result &Reachable) {
+  Result Res;
+
+  // 1. The HAL functions nothing reaches
+  DenseMap<const Function *, unsigned> Dead;
+  for (const auto &KV : Coverage.RegistersByHAL) {
+    const Function *F = KV.first;
+    if (Reachable.reaches(F) || F->hasAddressTaken())
+      continue;
+    ++Res.DeadHAL;
+    Dead[F] = ~0U;
+  }
+
+  // 2. Their registers accessed by bypasses, from the bypass -> HAL join
+  for (const FindHALCoverage::Suggestion &S : Coverage.Suggestions)
+    for (const auto &Reg : S.Registers)
+      for (const Function *HAL : Reg.second) {
+        auto It = Dead.find(HAL);
+        if (It == Dead.end())
+          continue;
+        if (It->second == ~0U) {
+          It->second = Res.Functions.size();
+          Res.Functions.push_back(
+              {HAL, unsigned(Coverage.RegistersByHAL.lookup(HAL).size()), {},
+               {}});
+        }
+        Shadowed &Sh = Res.Functions[It->second];
+        // The same register may be bypassed in several functions: keep one
+        // site per register
+        if (none_of(Sh.BypassSites, [&](const MMIOSite *B) {
+              return B->Addr == Reg.first->Addr;
+            }))
+          Sh.BypassSites.push_back(Reg.first);
+        if (!is_contained(Sh.Bypasses, S.Bypass))
+          Sh.Bypasses.push_back(S.Bypass);
+      }
+
+  // 3. Most bypassed registers first
+  auto ByName = [](const Function *A, const Function *B) {
+    return A->getName() < B->getName();
+  };
+  for (Shadowed &Sh : Res.Functions)
+    std::sort(Sh.Bypasses.begin(), Sh.Bypasses.end(), ByName);
+  std::sort(Res.Functions.begin(), Res.Functions.end(),
+            [&](const Shadowed &A, const Shadowed &B) {
+              if (A.BypassSites.size() != B.BypassSites.size())
+                return A.BypassSites.size() > B.BypassSites.size();
+              if (A.Bypasses.size() != B.Bypasses.size())
+                return A.Bypasses.size() > B.Bypasses.size();
+              return ByName(A.HAL, B.HAL);
+            });
+  return Res;
+}
+
+PreservedAnalyses FindDeadHALPrinter::run(Module &M,
+                                          ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &Res = MAM.getResult<FindDeadHAL>(M);
+
+  printDeadHALResult(OS, Sites, Res);
+  return PreservedAnalyses::all();
+}
+
+FindDeadHAL::Result FindDeadHAL::run(llvm::Module &M,
+                                     llvm::ModuleAnalysisManager &MAM) {
+  auto &Coverage = MAM.getResult<FindHALCoverage>(M);
+  auto &Reachable = MAM.getResult<AppReachability>(M);
+  return runOnModule(M, Coverage, Reachable);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindDeadHAL::Key;
+
+llvm::PassPluginLibraryInfo getFindDeadHALPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "dead-hal", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<dead-hal>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<dead-hal>") {
+                    MPM.addPass(FindDeadHALPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindDeadHAL>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindDeadHAL(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindDeadHALPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printDeadHALResult(raw_ostream &OutS,
+                               const FindMMIOSites::Result &Sites,
+                               const FindDeadHAL::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Unused HAL functions shadowed by bypasses\n";
+  OutS << "=================================================\n";
+  for (const FindDeadHAL::Shadowed &Sh : Res.Functions) {
+    OutS << Sh.HAL->getName() << ": " << Sh.BypassSites.size() << "/"
+         << Sh.Registers << " registers bypassed by ";
+    interleave(
+        Sh.Bypasses, OutS, [&](const Function *F) { OutS << F->getName(); },
+        ", ");
+    OutS << "\n";
+    for (const MMIOSite *S : Sh.BypassSites)
+      OutS << "    " << Sites.getRegisterName(*S) << " in "
+           << S->getFunction()->getName() << " at "
+           << getDebugLocString(S->Ins) << "\n";
+  }
+  OutS << Res.DeadHAL << " HAL functions with MMIO accesses are never called, "
+       << Res.Functions.size() << " of them shadowed by bypasses\n";
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
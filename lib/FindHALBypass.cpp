@@ -28,11 +28,13 @@
 
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Passes/PassBuilder.h"
-#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Debug.h"
 #include <algorithm>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "hal-bypass"
+
 // Pretty-prints the result of this analysis
 static void printHALBypassResult(llvm::raw_ostream &OutS,
                                  const FindHALBypass::Result &);
@@ -41,10 +43,10 @@ static void printHALBypassResult(llvm::raw_ostream &OutS,
 // FindHALBypass Implementation
 //------------------------------------------------------------------------------
 FindHALBypass::Result
-FindHALBypass::runOnModule(Module &M, const FindMMIOFunc::Result &MMIOFuncs) {
+FindHALBypass::runOnModule(Module &M, const FindMMIOFunc::Result &MMIOFuncs,
+                           const CallGraph &CG) {
   Result Res;
-  CallGraph CG = CallGraph(M);
-  CG.dump();
+  LLVM_DEBUG(CG.print(dbgs()));
 
   for (auto &F : CG) {
     std::string CallerName("NONAME");
@@ -69,7 +71,9 @@ FindHALBypass::runOnModule(Module &M, const FindMMIOFunc::Result &MMIOFuncs) {
       //                         return F.Func == Callee;
       //                       });
       if (It != MMIOFuncs.end()) {
-        dbgs() << "HAL bypass: " << CallerName << " -> " << CalleeName << "\n";
+        LLVM_DEBUG(dbgs() << "HAL bypass: " << CallerName << " -> "
+                          << CalleeName << "\n");
+        Res.emplace_back(F.first, Callee);
       }
     }
   }
@@ -92,7 +96,8 @@ PreservedAnalyses FindHALBypassPrinter::run(Module &M,
 FindHALBypass::Result FindHALBypass::run(llvm::Module &M,
                                          llvm::ModuleAnalysisManager &MAM) {
   auto &Funcs = MAM.getResult<FindMMIOFunc>(M);
-  return runOnModule(M, Funcs);
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  return runOnModule(M, Funcs, CG);
 }
 
 // bool LegacyFindHALBypass::runOnModule(llvm::Module &M) {
@@ -107,46 +112,9 @@ FindHALBypass::Result FindHALBypass::run(llvm::Module &M,
 //------------------------------------------------------------------------------
 // New PM Registration
 //------------------------------------------------------------------------------
+// The plugin entry point is in FindHALBypassPlugin.cpp
 AnalysisKey FindHALBypass::Key;
 
-llvm::PassPluginLibraryInfo getFindHALBypassPluginInfo() {
-  return {LLVM_PLUGIN_API_VERSION, "hal-bypass", LLVM_VERSION_STRING,
-          [](PassBuilder &PB) {
-            // #1 REGISTRATION FOR "opt -passes=print<hal-bypass>"
-            PB.registerPipelineParsingCallback(
-                [&](StringRef Name, ModulePassManager &MPM,
-                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "print<hal-bypass>") {
-                    MPM.addPass(FindHALBypassPrinter(llvm::errs()));
-                    return true;
-                  }
-                  return false;
-                });
-            // #2 REGISTRATION FOR "MAM.getResult<FindHALBypass>(Module)"
-            PB.registerAnalysisRegistrationCallback(
-                [](ModuleAnalysisManager &MAM) {
-                  MAM.registerPass([&] { return FindHALBypass(); });
-                });
-          }};
-};
-
-extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
-llvmGetPassPluginInfo() {
-  return getFindHALBypassPluginInfo();
-}
-
-//------------------------------------------------------------------------------
-// Legacy PM Registration
-//------------------------------------------------------------------------------
-// char LegacyFindHALBypass::ID = 0;
-//
-//// #1 REGISTRATION FOR "opt -analyze -legacy-static-cc"
-// RegisterPass<LegacyFindHALBypass>
-//    X(/*PassArg=*/"legacy-static-cc",
-//      /*Name=*/"LegacyFindHALBypass",
-//      /*CFGOnly=*/true,
-//      /*is_analysis=*/true);
-
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
@@ -155,6 +123,12 @@ static void printHALBypassResult(raw_ostream &OutS,
   OutS << "================================================="
        << "\n";
   OutS << "LLVM-TUTOR: HAL bypass\n";
+  for (auto &Call : MMIOFunc) {
+    const Function *Caller = Call.first;
+    OutS << "HAL bypass: "
+         << (Caller && Caller->hasName() ? Caller->getName() : "NONAME")
+         << " -> " << Call.second->getName() << "\n";
+  }
   //  const char *str1 = "NAME";
   //  const char *str2 = "#N DIRECT CALLS";
   //  OutS << format("%-20s %-10s\n", str1, str2);
@@ -0,0 +1,60 @@
+//==============================================================================
+// FILE:
+//    FindHALBypassPlugin.cpp
+//
+// DESCRIPTION:
+//    The pass plugin entry point of libFindHALBypass: registers
+//    "print<hal-bypass>". The analysis itself lives in FindHALBypass.cpp,
+//    which is also built into the HALBypass library (include/HALBypass.h).
+//
+// License: MIT
+//==============================================================================
+#include "FindHALBypass.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getFindHALBypassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "hal-bypass", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<hal-bypass>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<hal-bypass>") {
+                    MPM.addPass(FindHALBypassPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindHALBypass>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindHALBypass(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindHALBypassPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Legacy PM Registration
+//------------------------------------------------------------------------------
+// char LegacyFindHALBypass::ID = 0;
+//
+//// #1 REGISTRATION FOR "opt -analyze -legacy-static-cc"
+// RegisterPass<LegacyFindHALBypass>
+//    X(/*PassArg=*/"legacy-static-cc",
+//      /*Name=*/"LegacyFindHALBypass",
+//      /*CFGOnly=*/true,
+//      /*is_analysis=*/true);
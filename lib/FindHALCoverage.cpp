@@ -0,0 +1,187 @@
+//==============================================================================
+// FILE:
+//    FindHALCoverage.cpp
+//
+// DESCRIPTION:
+//    When a bypass writes a register such as TWIM0->ADDRESS, the fix is
+//    usually to call the HAL function that already writes it. This pass
+//    builds an index of the registers that HAL functions access, from the
+//    same MMIO scan as the bypasses (FindMMIOSites), i.e. the functions with
+//    MMIO accesses that FindMMIOFunc classifies as HAL. Every register a
+//    bypass accesses is then looked up in the index, and the HAL functions
+//    found are ranked by how many of the bypass' registers they cover:
+//
+//      twi_read
+//        &i2c0[0x588] (twi.c:12:3): nrf_twim_address_set, nrfx_twim_xfer
+//        &i2c0[0x508] (twi.c:13:3): nrfx_twim_xfer
+//        candidates: nrfx_twim_xfer (2/2), nrf_twim_address_set (1/2)
+//
+//    Registers are matched by address, so an access through a variable
+//    index (NRF_GPIO->PIN_CNF[Pin]) matches the accesses to element 0.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -passes="print<hal-coverage>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindHALCoverage.h"
+
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/STLExtras.h"
+#include <algorithm>
+
+using namespace llvm;
+
+// Pretty-prints the result of this analysis
+static void printHALCoverageResult(llvm::raw_ostream &OutS,
+                                   const FindMMIOSites::Result &Sites,
+                                   const FindHALCoverage::Result &);
+
+static bool byName(const Function *A, const Function *B) {
+  return A->getName() < B->getName();
+}
+
+//------------------------------------------------------------------------------
+// FindHALCoverage Implementation
+//------------------------------------------------------------------------------
+ArrayRef<const Function *>
+FindHALCoverage::Result::getHALFunctions(uint64_t Addr) const {
+  auto It = HALByRegister.find(Addr);
+  if (It == HALByRegister.end())
+    return {};
+  return It->second;
+}
+
+FindHALCoverage::Result
+FindHALCoverage::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                             const FindMMIOFunc::Result &MMIOFuncs) {
+  Result Res;
+
+  // 1. Index the registers of the HAL functions, i.e. of the functions with
+  // MMIO accesses that aren't non-HAL MMIO functions. The sites of a
+  // function are contiguous, so each function is added to a register once.
+  for (const MMIOSite &S : Sites.Sites) {
+    const Function *F = S.getFunction();
+    if (MMIOFuncs.count(F))
+      continue;
+    auto &Funcs = Res.HALByRegister[S.Addr];
+    if (Funcs.empty() || Funcs.back() != F) {
+      Funcs.push_back(F);
+      Res.RegistersByHAL[F].push_back(S.Addr);
+    }
+  }
+  for (auto &KV : Res.HALByRegister)
+    std::sort(KV.second.begin(), KV.second.end(), byName);
+  for (auto &KV : Res.RegistersByHAL) {
+    std::sort(KV.second.begin(), KV.second.end());
+    KV.second.erase(std::unique(KV.second.begin(), KV.second.end()),
+                    KV.second.end());
+  }
+
+  // 2. Join the registers of every bypass against the index
+  for (const MMIOFuncGroup &G : foldInstantiations(MMIOFuncs,
+                                                   /*AppOnly=*/true)) {
+    Suggestion Sugg;
+    Sugg.Bypass = G.Instances[0];
+    DenseSet<uint64_t> Seen;
+    DenseMap<const Function *, unsigned> Covered;
+    for (const MMIOSite &S : Sites.getSites(Sugg.Bypass)) {
+      if (!Seen.insert(S.Addr).second)
+        continue;
+      ArrayRef<const Function *> HAL = Res.getHALFunctions(S.Addr);
+      Sugg.Registers.emplace_back(&S, HAL);
+      for (const Function *F : HAL)
+        ++Covered[F];
+    }
+    Sugg.Candidates.assign(Covered.begin(), Covered.end());
+    std::sort(Sugg.Candidates.begin(), Sugg.Candidates.end(),
+              [](const std::pair<const Function *, unsigned> &A,
+                 const std::pair<const Function *, unsigned> &B) {
+                if (A.second != B.second)
+                  return A.second > B.second;
+                return byName(A.first, B.first);
+              });
+    Res.Suggestions.push_back(std::move(Sugg));
+  }
+  return Res;
+}
+
+FindHALCoverage::Result FindHALCoverage::run(llvm::Module &M,
+                                             llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &MMIOFuncs = MAM.getResult<FindMMIOFunc>(M);
+  return runOnModule(M, Sites, MMIOFuncs);
+}
+
+PreservedAnalyses FindHALCoveragePrinter::run(Module &M,
+                                              ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &Res = MAM.getResult<FindHALCoverage>(M);
+
+  printHALCoverageResult(OS, Sites, Res);
+  return PreservedAnalyses::all();
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindHALCoverage::Key;
+
+void registerFindHALCoverage(PassBuilder &PB) {
+  // #1 REGISTRATION FOR "opt -passes=print<hal-coverage>"
+  PB.registerPipelineParsingCallback(
+      [&](StringRef Name, ModulePassManager &MPM,
+          ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "print<hal-coverage>") {
+          MPM.addPass(FindHALCoveragePrinter(llvm::errs()));
+          return true;
+        }
+        return false;
+      });
+  // #2 REGISTRATION FOR "MAM.getResult<FindHALCoverage>(Module)"
+  PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager &MAM) {
+    MAM.registerPass([&] { return FindHALCoverage(); });
+  });
+}
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printHALCoverageResult(raw_ostream &OutS,
+                                   const FindMMIOSites::Result &Sites,
+                                   const FindHALCoverage::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: HAL replacements for bypasses\n";
+  OutS << "=================================================\n";
+  for (const FindHALCoverage::Suggestion &S : Res.Suggestions) {
+    OutS << S.Bypass->getName() << "\n";
+    for (const auto &Reg : S.Registers) {
+      OutS << "  " << Sites.getRegisterName(*Reg.first) << " ("
+           << getDebugLocString(Reg.first->Ins) << "): ";
+      if (Reg.second.empty())
+        OutS << "no HAL function";
+      else
+        interleave(
+            Reg.second, OutS,
+            [&](const Function *F) { OutS << F->getName(); }, ", ");
+      OutS << "\n";
+    }
+    if (S.Candidates.empty())
+      continue;
+    OutS << "  candidates: ";
+    interleave(
+        S.Candidates, OutS,
+        [&](const std::pair<const Function *, unsigned> &C) {
+          OutS << C.first->getName() << " (" << C.second << "/"
+               << S.Registers.size() << ")";
+        },
+        ", ");
+    OutS << "\n";
+  }
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
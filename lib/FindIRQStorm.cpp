@@ -0,0 +1,269 @@
+//==============================================================================
+// FILE:
+//    FindIRQStorm.cpp
+//
+// DESCRIPTION:
+//    Finds interrupt handlers that may return without clearing an event
+//    they service. On nRF5x, an interrupt stays pending for as long as the
+//    EVENTS_* register that raised it is non-zero, so an ISR that doesn't
+//    write 0 to it re-enters immediately and starves the rest of the system.
+//
+//    For every ISR (see isISR()) and every EVENTS register read by a
+//    function it calls, a clearing store (`NRF_UART0->EVENTS_RXDRDY = 0`, or
+//    a call to a nrf_*_event_clear() HAL helper) must be made on every path
+//    to the return of the function that reads the event, or of the ISR
+//    itself. Paths on which the event was tested and found not set, e.g. the
+//    else branch of
+//
+//      if (NRF_UART0->EVENTS_RXDRDY) { NRF_UART0->EVENTS_RXDRDY = 0; ... }
+//
+//    don't need to clear it. Calls to functions that always clear the event
+//    count as clears.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindIRQStorm.so `\`
+//        -passes="print<irq-storm>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindIRQStorm.h"
+#include "CallPaths.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Debug.h"
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "irq-storm"
+
+// Pretty-prints the result of this analysis
+static void printIRQStormResult(llvm::raw_ostream &OutS,
+                                const FindIRQStorm::Result &);
+
+//------------------------------------------------------------------------------
+// FindIRQStorm Implementation
+//------------------------------------------------------------------------------
+// True if V is a read of the register at Addr (possibly masked or cast), or
+// the result of a call to a getter that reads it
+static bool readsRegister(const Value *V, uint64_t Addr,
+                          const FindMMIOSites::Result &Sites) {
+  using namespace PatternMatch;
+  for (;;) {
+    const Value *Op;
+    if (match(V, m_CombineOr(m_ZExtOrSExt(m_Value(Op)), m_Trunc(m_Value(Op)))) ||
+        match(V, m_And(m_Value(Op), m_ConstantInt())))
+      V = Op;
+    else
+      break;
+  }
+  if (auto *Load = dyn_cast<LoadInst>(V)) {
+    const MMIOSite *S = Sites.getSite(Load);
+    return S && S->Exact && S->Addr == Addr;
+  }
+  if (auto *Call = dyn_cast<CallBase>(V))
+    if (const Function *Callee = Call->getCalledFunction())
+      for (const MMIOSite &S : Sites.getSites(Callee))
+        if (S.isLoad() && S.Addr == Addr)
+          return true;
+  return false;
+}
+
+// If Cond tests the event register at Addr against zero, returns the
+// successor of Br taken when the event is set
+static const BasicBlock *getEventSetSuccessor(const BranchInst &Br,
+                                              uint64_t Addr,
+                                              const FindMMIOSites::Result &Sites) {
+  if (!Br.isConditional())
+    return nullptr;
+  auto *Cmp = dyn_cast<ICmpInst>(Br.getCondition());
+  if (!Cmp || !Cmp->isEquality())
+    return nullptr;
+  const Value *LHS = Cmp->getOperand(0), *RHS = Cmp->getOperand(1);
+  if (!PatternMatch::match(RHS, PatternMatch::m_Zero()))
+    std::swap(LHS, RHS);
+  if (!PatternMatch::match(RHS, PatternMatch::m_Zero()) ||
+      !readsRegister(LHS, Addr, Sites))
+    return nullptr;
+  // "eq 0" is true when the event is *not* set
+  return Br.getSuccessor(Cmp->getPredicate() == ICmpInst::ICMP_EQ ? 1 : 0);
+}
+
+bool FindIRQStorm::isClear(const Instruction &I, uint64_t Addr) {
+  if (const MMIOSite *S = Sites->getSite(&I))
+    return S->IsStore && S->Exact && S->Addr == Addr && S->StoredValue &&
+           *S->StoredValue == 0;
+
+  auto *Call = dyn_cast<CallBase>(&I);
+  const Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+  if (!Callee)
+    return false;
+  // nrf_<periph>_event_clear(p_reg, event): the address is computed from the
+  // arguments, so it can only be checked if both are constants
+  if (Callee->getName().contains("event_clear")) {
+    if (Call->arg_size() < 2)
+      return true;
+    bool Exact;
+    Optional<uint64_t> Base = getConstantAddress(
+        Call->getArgOperand(0), I.getModule()->getDataLayout(), Exact);
+    auto *Offset = dyn_cast<ConstantInt>(Call->getArgOperand(1));
+    if (!Base || !Exact || !Offset)
+      return true;
+    return *Base + Offset->getZExtValue() == Addr;
+  }
+  return !Callee->isDeclaration() && alwaysClears(Callee, Addr);
+}
+
+bool FindIRQStorm::alwaysClears(const Function *F, uint64_t Addr) {
+  auto It = Clears.try_emplace({F, Addr}, false);
+  if (!It.second)
+    return It.first->second;
+  bool Res = clearsOnAllPaths(&F->getEntryBlock().front(), Addr);
+  Clears[{F, Addr}] = Res;
+  return Res;
+}
+
+bool FindIRQStorm::clearsOnAllPaths(const Instruction *From, uint64_t Addr) {
+  // Scans [I, End) for a clear
+  auto ScanClears = [&](BasicBlock::const_iterator I,
+                        BasicBlock::const_iterator End) {
+    for (; I != End; ++I)
+      if (isClear(*I, Addr))
+        return true;
+    return false;
+  };
+  SmallVector<const BasicBlock *, 8> Worklist;
+  auto PushSuccessors = [&](const BasicBlock *BB) {
+    auto *Br = dyn_cast<BranchInst>(BB->getTerminator());
+    if (const BasicBlock *Set =
+            Br ? getEventSetSuccessor(*Br, Addr, *Sites) : nullptr)
+      Worklist.push_back(Set);
+    else
+      Worklist.append(succ_begin(BB), succ_end(BB));
+  };
+
+  const BasicBlock *Start = From->getParent();
+  if (ScanClears(From->getIterator(), Start->end()))
+    return true;
+  if (isa<ReturnInst>(Start->getTerminator()))
+    return false;
+  PushSuccessors(Start);
+
+  SmallPtrSet<const BasicBlock *, 16> Visited;
+  while (!Worklist.empty()) {
+    const BasicBlock *BB = Worklist.pop_back_val();
+    if (!Visited.insert(BB).second || ScanClears(BB->begin(), BB->end()))
+      continue;
+    if (isa<ReturnInst>(BB->getTerminator()))
+      return false;
+    PushSuccessors(BB);
+  }
+  return true;
+}
+
+FindIRQStorm::Result
+FindIRQStorm::runOnModule(Module &M, const FindMMIOSites::Result &S,
+                          const CallGraph &CG) {
+  Result Res;
+  Sites = &S;
+
+  for (const Function *ISR : getISRs(M)) {
+    LLVM_DEBUG(dbgs() << "ISR: " << ISR->getName() << "\n");
+    CallPaths Paths(CG, ISR);
+    std::set<uint64_t> Checked;
+    for (const Function *F : Paths.functions())
+      for (const MMIOSite &Read : Sites->getSites(F)) {
+        if (Read.IsStore || !Read.Exact ||
+            Sites->getRegister(Read) != NRFRegister::Event ||
+            !Checked.insert(Read.Addr).second)
+          continue;
+        if (clearsOnAllPaths(Read.Ins->getNextNode(), Read.Addr) ||
+            clearsOnAllPaths(&ISR->getEntryBlock().front(), Read.Addr))
+          continue;
+        Res.push_back({ISR, &Read, Sites->getRegisterName(Read),
+                       Paths.getPath(F)});
+      }
+  }
+  return Res;
+}
+
+PreservedAnalyses FindIRQStormPrinter::run(Module &M,
+                                           ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindIRQStorm>(M);
+
+  printIRQStormResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindIRQStorm::Result FindIRQStorm::run(llvm::Module &M,
+                                       llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  return runOnModule(M, Sites, CG);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindIRQStorm::Key;
+
+llvm::PassPluginLibraryInfo getFindIRQStormPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "irq-storm", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<irq-storm>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<irq-storm>") {
+                    MPM.addPass(FindIRQStormPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindIRQStorm>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindIRQStorm(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindIRQStormPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printIRQStormResult(raw_ostream &OutS,
+                                const FindIRQStorm::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Events not cleared by ISRs\n";
+  OutS << "=================================================\n";
+  for (const auto &V : Res) {
+    OutS << V.ISR->getName() << ": " << V.Register << " read at "
+         << getDebugLocString(V.Read->Ins) << " is not cleared on all paths\n";
+    if (V.Path.size() > 1) {
+      OutS << "    via ";
+      for (size_t I = 0; I < V.Path.size(); ++I)
+        OutS << (I ? " -> " : "") << V.Path[I]->getName();
+      OutS << "\n";
+    }
+  }
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
@@ -0,0 +1,259 @@
+//==============================================================================
+// FILE:
+//    FindInitSequences.cpp
+//
+// DESCRIPTION:
+//    Extracts the register initialization sequences of drivers so that they
+//    can be replaced by a table and a loop:
+//
+//      static const struct { uint16_t Offset; uint16_t Value; } T[] = {...};
+//      for (i = 0; i < N; i++)
+//        *(volatile uint32_t *)(BASE + T[i].Offset) = T[i].Value;
+//
+//    A sequence is a run of constant stores to exact register addresses in
+//    one basic block, not interrupted by calls, MMIO reads or other MMIO
+//    stores (which may depend on the order). The runs of a function are
+//    split per peripheral, keeping their order, and the runs of a peripheral
+//    are merged into one sequence as long as their blocks always execute
+//    together: each block dominates the next, which post-dominates it, in
+//    the same loop. Runs on either side of a branch (or in a loop) start
+//    sequences of their own. Init functions are those with "init" in their
+//    name, or with at least -init-min-writes constant register writes.
+//
+//    Code size is estimated for Thumb-2: a 16-bit STR (32-bit beyond offset
+//    124), plus a MOVS for values below 256 or an LDR and a literal
+//    otherwise, plus the peripheral base from the literal pool. The table
+//    costs 4 bytes per entry (8 if a value needs more than 16 bits), and the
+//    loop and base ~20 bytes.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindInitSequences.so `\`
+//        -passes="print<init-sequences>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindInitSequences.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include <algorithm>
+#include <map>
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+    InitMinWrites("init-min-writes",
+                  cl::desc("Constant register writes that make a function "
+                           "without 'init' in its name an init function"),
+                  cl::init(4));
+
+// Pretty-prints the result of this analysis
+static void printInitSequencesResult(llvm::raw_ostream &OutS,
+                                     const FindInitSequences::Result &);
+
+//------------------------------------------------------------------------------
+// FindInitSequences Implementation
+//------------------------------------------------------------------------------
+// Thumb-2 size estimates, in bytes
+static unsigned getStoreBytes(uint64_t Offset, uint64_t Value) {
+  unsigned Str = Offset <= 124 ? 2 : 4;
+  unsigned Val = Value < 256 ? 2 : 2 + 4;
+  return Str + Val;
+}
+static constexpr unsigned BaseBytes = 2 + 4;
+static constexpr unsigned TableEntryBytes = 4;
+static constexpr unsigned WideTableEntryBytes = 8;
+static constexpr unsigned TableLoopBytes = 20;
+
+FindInitSequences::Result
+FindInitSequences::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                               FunctionAnalysisManager &FAM) {
+  Result Res;
+  for (Function &F : M) {
+    ArrayRef<MMIOSite> FuncSites = Sites.getSites(&F);
+    unsigned ConstWrites = std::count_if(
+        FuncSites.begin(), FuncSites.end(), [](const MMIOSite &S) {
+          return S.IsStore && S.Exact && S.StoredValue;
+        });
+    bool IsInit = F.getName().contains_insensitive("init") ||
+                  ConstWrites >= InitMinWrites;
+    if (!IsInit || ConstWrites < 2)
+      continue;
+
+    auto &DT = FAM.getResult<DominatorTreeAnalysis>(F);
+    auto &PDT = FAM.getResult<PostDominatorTreeAnalysis>(F);
+    auto &LI = FAM.getResult<LoopAnalysis>(F);
+    // True if the writes of B always follow those of A, once
+    auto AlwaysFollows = [&](const BasicBlock *A, const BasicBlock *B) {
+      return A == B || (DT.dominates(A, B) && PDT.dominates(B, A) &&
+                        LI.getLoopFor(A) == LI.getLoopFor(B));
+    };
+
+    // All the sequences, in order of first write, and the last one of every
+    // peripheral with the block it ends in
+    std::vector<InitSequence> Sequences;
+    std::map<uint64_t, std::pair<unsigned, const BasicBlock *>> Last;
+    // Dominators first
+    ReversePostOrderTraversal<Function *> RPOT(&F);
+    for (const BasicBlock *BB : RPOT) {
+      std::vector<const MMIOSite *> Run;
+      auto EndRun = [&]() {
+        if (Run.size() >= 2)
+          for (const MMIOSite *S : Run) {
+            uint64_t Base = Sites.getPeripheralBase(*S);
+            auto It = Last.find(Base);
+            bool New =
+                It == Last.end() || !AlwaysFollows(It->second.second, BB);
+            auto &Cur = Last[Base];
+            if (New) {
+              InitSequence Seq;
+              Seq.Func = &F;
+              Seq.Peripheral = Sites.getPeripheralName(*S);
+              Seq.Base = Base;
+              Sequences.push_back(std::move(Seq));
+              Cur.first = Sequences.size() - 1;
+            }
+            Cur.second = BB;
+            Sequences[Cur.first].Writes.push_back(
+                {S->Addr - Base, *S->StoredValue});
+          }
+        Run.clear();
+      };
+      for (const Instruction &I : *BB) {
+        const MMIOSite *S = Sites.getSite(&I);
+        if (S && S->IsStore && S->Exact && S->StoredValue)
+          Run.push_back(S);
+        else if (S || isa<CallBase>(I))
+          EndRun();
+      }
+      EndRun();
+    }
+
+    for (InitSequence &Seq : Sequences) {
+      Seq.UnrolledBytes = BaseBytes;
+      for (const auto &W : Seq.Writes) {
+        Seq.UnrolledBytes += getStoreBytes(W.first, W.second);
+        Seq.Wide |= W.first > UINT16_MAX || W.second > UINT16_MAX;
+      }
+      Seq.TableBytes =
+          Seq.Writes.size() * (Seq.Wide ? WideTableEntryBytes : TableEntryBytes) +
+          TableLoopBytes;
+      if (Seq.getSavedBytes() > 0)
+        Res.push_back(std::move(Seq));
+    }
+  }
+
+  std::stable_sort(Res.begin(), Res.end(),
+                   [](const InitSequence &A, const InitSequence &B) {
+                     return A.getSavedBytes() > B.getSavedBytes();
+                   });
+  return Res;
+}
+
+PreservedAnalyses FindInitSequencesPrinter::run(Module &M,
+                                                ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindInitSequences>(M);
+
+  printInitSequencesResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindInitSequences::Result
+FindInitSequences::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &FAM =
+      MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+  return runOnModule(M, Sites, FAM);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindInitSequences::Key;
+
+llvm::PassPluginLibraryInfo getFindInitSequencesPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "init-sequences", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<init-sequences>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<init-sequences>") {
+                    MPM.addPass(FindInitSequencesPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindInitSequences>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindInitSequences(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindInitSequencesPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+// "_ZN6Driver4initEv", "&uart0" -> "_ZN6Driver4initEv_uart0"
+static std::string getTableName(const FindInitSequences::InitSequence &Seq) {
+  std::string Name = (Seq.Func->getName() + "_" + Seq.Peripheral).str();
+  for (char &C : Name)
+    if (!isAlnum(C))
+      C = '_';
+  Name.erase(std::unique(Name.begin(), Name.end(),
+                         [](char A, char B) { return A == '_' && B == '_'; }),
+             Name.end());
+  return Name;
+}
+
+static void printInitSequencesResult(raw_ostream &OutS,
+                                     const FindInitSequences::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Register init sequences\n";
+  OutS << "=================================================\n";
+  int Total = 0;
+  // A function may initialize a peripheral in several sequences
+  StringMap<unsigned> TableNames;
+  for (const auto &Seq : Res) {
+    Total += Seq.getSavedBytes();
+    std::string TableName = getTableName(Seq);
+    if (unsigned N = TableNames[TableName]++)
+      TableName += "_" + std::to_string(N + 1);
+    OutS << "// " << Seq.Func->getName() << ": " << Seq.Peripheral;
+    if (!StringRef(Seq.Peripheral).startswith("0x"))
+      OutS << " (0x" << Twine::utohexstr(Seq.Base) << ")";
+    OutS << ", " << Seq.Writes.size()
+         << " writes, ~" << Seq.UnrolledBytes << " -> ~" << Seq.TableBytes
+         << " bytes\n";
+    OutS << "static const struct { uint16_t Offset; "
+         << (Seq.Wide ? "uint32_t" : "uint16_t") << " Value; } "
+         << TableName << "[] = {\n";
+    for (const auto &W : Seq.Writes)
+      OutS << "  {0x" << Twine::utohexstr(W.first) << ", 0x"
+           << Twine::utohexstr(W.second) << "},\n";
+    OutS << "};\n";
+  }
+  OutS << "// Total: ~" << Total << " bytes saved\n";
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
@@ -25,13 +25,37 @@
 // License: MIT
 //==============================================================================
 #include "FindMMIOFunc.h"
+#include "CallPaths.h"
 
 #include "llvm/Passes/PassBuilder.h"
-#include "llvm/Passes/PassPlugin.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
+#include <set>
+#include <tuple>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "mmio-func"
+
+static cl::opt<std::string> CacheFile(
+    "mmio-cache",
+    cl::desc("Findings of the previous run. New findings are flagged, and "
+             "with -changed-files the findings outside of the change are "
+             "kept"),
+    cl::value_desc("file"));
+
+static cl::opt<bool> Stream(
+    "mmio-stream",
+    cl::desc("Print every finding to stderr as soon as it is confirmed, "
+             "followed by refinements (call paths from the application "
+             "roots)"),
+    cl::init(false));
+
 // Pretty-prints the result of this analysis
 static void printMMIOFuncResult(llvm::raw_ostream &OutS,
                                 const FindMMIOFunc::Result &);
@@ -39,97 +63,174 @@ static void printMMIOFuncResult(llvm::raw_ostream &OutS,
 //------------------------------------------------------------------------------
 // FindMMIOFunc Implementation
 //------------------------------------------------------------------------------
-// InstTy = LoadInst or StoreInst
-template <typename InstTy>
-bool FindMMIOFunc::isMMIOInst_(llvm::Instruction *Ins) {
-  auto *TheIns = dyn_cast<InstTy>(Ins);
-  if (!TheIns)
-    return false;
-  auto *CE = dyn_cast<ConstantExpr>(TheIns->getPointerOperand());
-  if (!(CE && CE->getOpcode() == Instruction::IntToPtr))
-    return false;
-
-  dbgs() << *Ins << "\n";
-  const APInt &Addr = cast<ConstantInt>(CE->getOperand(0))->getValue();
-  SmallVector<char> Str;
-  Addr.toStringUnsigned(Str, 16);
-  dbgs() << "Addr: " << Str << "\n";
-
-  const DebugLoc &Debug = Ins->getDebugLoc();
-  if (Debug) {
-    dbgs() << *Debug << "\n";
-    //Debug.dump();
-  }
-
-  return true;
+static bool containHalStr(StringRef Str) {
+  return Str.contains("hal") && !Str.contains("halt");
 }
 
-bool FindMMIOFunc::isMMIOInst(llvm::Instruction *Ins) {
-  return (isMMIOInst_<LoadInst>(Ins) || isMMIOInst_<StoreInst>(Ins) ||
-          isMMIOInst_<GetElementPtrInst>(Ins));
+bool isHalByName(const Function &F) {
+  const DISubprogram *DISub = F.getSubprogram();
+  // Without debug info, the linkage name is all there is
+  if (!DISub)
+    return containHalStr(F.getName());
+  return containHalStr(DISub->getName()) ||
+         containHalStr(DISub->getLinkageName()) ||
+         containHalStr(DISub->getFilename());
 }
 
-bool FindMMIOFunc::containHalStr(const std::string &Str) {
-  return (Str.find("hal") != std::string::npos &&
-          Str.find("halt") == std::string::npos);
+bool mayBeAppByPath(const Function &F) {
+  const DISubprogram *DISub = F.getSubprogram();
+  if (!DISub || !DISub->getFile())
+    return true;
+  StringRef Filename = DISub->getFile()->getFilename();
+  if (Filename.contains("SDK"))
+    return false;
+  // Match "lib", "libs", "libc++" ... directories, but not "calibration"
+  StringRef Dir = sys::path::parent_path(Filename);
+  for (auto It = sys::path::begin(Dir), E = sys::path::end(Dir); It != E; ++It)
+    if (It->startswith("lib"))
+      return false;
+  return true;
 }
 
 bool FindMMIOFunc::isHalFunc(const llvm::Function &F) {
+  // -mmio-scan-stats only times the classification, not the debug output
+  Layer L;
+  bool IsHal;
+  {
+    ClassifyTimer Timer(Stats.get(), F);
+    L = Classifier.classify(F);
+    IsHal = L != Layer::Unknown ? L == Layer::HAL : isHalByName(F);
+  }
+  if (L != Layer::Unknown)
+    return IsHal;
+
   DISubprogram *DISub = F.getSubprogram();
   if (!DISub) {
-    dbgs() << "No debug info for this func\n";
-    return false;
-  }
-  DISub->dump();
-  DIFile *File = DISub->getFile();
-  File->dump();
-
-  std::string Name(DISub->getName());
-  std::string LinkageName(DISub->getLinkageName());
-  std::string Filename(File->getFilename());
-  if (containHalStr(Name) || containHalStr(LinkageName) ||
-      containHalStr(Filename)) {
-    dbgs() << "Hal function: " << DISub->getName() << " "
-      << LinkageName << " " << Filename << "\n";
-    return true;
+    LLVM_DEBUG(dbgs() << "No debug info for this func\n");
+    return IsHal;
   }
-  return false;
+  LLVM_DEBUG(DISub->print(dbgs()); dbgs() << "\n");
+
+  if (IsHal)
+    LLVM_DEBUG(dbgs() << "Hal function: " << DISub->getName() << " "
+                      << DISub->getLinkageName() << " "
+                      << DISub->getFilename() << "\n");
+  return IsHal;
 }
 
 bool FindMMIOFunc::isAppFunc(const llvm::Function &F) {
   // return true if F MAY be an application function
-  DISubprogram *DISub = F.getSubprogram();
-  if (!DISub || !DISub->getFile())
-    return true;
-  std::string Filename(DISub->getFile()->getFilename());
-  if (Filename.find("SDK") != std::string::npos)
-    return false;
-  if (Filename.find("lib") != std::string::npos)
-    return false;
-  return true;
+  ClassifyTimer Timer(Stats.get(), F);
+  Layer L = Classifier.classify(F);
+  if (L != Layer::Unknown)
+    return L == Layer::App;
+  return mayBeAppByPath(F);
 }
 
-void FindMMIOFunc::findNonHalMMIOFunc(Module &M, Result &MMIOFuncs) {
+void FindMMIOFunc::findNonHalMMIOFunc(Module &M,
+                                      const FindMMIOSites::Result &Sites,
+                                      Result &MMIOFuncs) {
   for (auto &Func : M) {
-    if (isHalFunc(Func))
-      goto CheckNextFunction;
-    for (auto &Ins: instructions(Func)) {
-      if (isMMIOInst(&Ins)) {
-        dbgs() << "Non-hal MMIO func: " << Func.getName() << "\n";
-        //MMIOFuncs[&Func] = NonHalMMIOFunc(&Ins);
-        MMIOFuncs.insert({&Func, NonHalMMIOFunc(&Ins)});
-        goto CheckNextFunction;
-      }
+    // Record the first MMIO access of every non-HAL function
+    ArrayRef<MMIOSite> FuncSites = Sites.getSites(&Func);
+    if (FuncSites.empty() || isHalFunc(Func))
+      continue;
+    const MMIOSite &S = FuncSites.front();
+    LLVM_DEBUG(dbgs() << "Non-hal MMIO func: " << Func.getName() << "\n");
+    NonHalMMIOFunc F(S.Ins);
+    F.Addr = S.Addr;
+    if (const Region *P = Sites.getPeripheral(S)) {
+      F.Peripheral = P->Name;
+      F.PeripheralBase = P->Begin;
     }
-CheckNextFunction:
-    dbgs() << "\n";
-    continue;
+    MMIOFuncs.insert({&Func, F});
+    if (Stream)
+      streamDirectAppCallers(Func, F);
+  }
+}
+
+//------------------------------------------------------------------------------
+// Streaming (-mmio-stream)
+//------------------------------------------------------------------------------
+// Lines are written with a single (unbuffered) write each, so that log
+// collectors never see partial findings
+static void streamFinding(const Function &F,
+                          const FindMMIOFunc::NonHalMMIOFunc &Info,
+                          StringRef Caller) {
+  std::string Line;
+  raw_string_ostream OS(Line);
+  OS << "mmio-func: finding " << F.getName() << " ("
+     << getDebugLocString(Info.MMIOIns) << ") called by " << Caller << "\n";
+  errs() << OS.str();
+}
+
+void FindMMIOFunc::streamDirectAppCallers(const Function &F,
+                                          const NonHalMMIOFunc &Info) {
+  // Direct calls from application code, known before the call graph is
+  // built
+  for (const User *U : F.users()) {
+    auto *Call = dyn_cast<CallBase>(U);
+    if (!Call || Call->getCalledFunction() != &F ||
+        !isAppFunc(*Call->getFunction()))
+      continue;
+    Streamed.insert(&F);
+    streamFinding(F, Info, Call->getFunction()->getName());
+    return;
+  }
+}
+
+void FindMMIOFunc::streamRefinements(
+    const Result &MMIOFuncs, const AppReachability::Result &Reachable) {
+  // Findings only the call graph confirms (called from outside the module)
+  for (auto &KV : MMIOFuncs)
+    if (KV.second.CalledByApp && !Streamed.count(KV.first))
+      streamFinding(*KV.first, KV.second,
+                    KV.second.Caller ? KV.second.Caller->getName()
+                                     : "external node");
+
+  // How the application gets there
+  const CallPaths &Paths = Reachable.App;
+  for (auto &KV : MMIOFuncs) {
+    if (!KV.second.CalledByApp || !Paths.reaches(KV.first))
+      continue;
+    std::string Line;
+    raw_string_ostream OS(Line);
+    OS << "mmio-func: path " << KV.first->getName() << ": ";
+    std::vector<const Function *> Path = Paths.getPath(KV.first);
+    for (size_t I = 0; I < Path.size(); ++I)
+      OS << (I ? " -> " : "") << Path[I]->getName();
+    OS << "\n";
+    errs() << OS.str();
   }
+  Streamed.clear();
 }
 
-void FindMMIOFunc::checkCalledByApp(Module &M, Result &MMIOFuncs) {
-  CallGraph CG = CallGraph(M);
-  CG.dump();
+void FindMMIOFunc::checkCalledByApp(const ChangeScope &Scope,
+                                    CallGraphGetter GetCG,
+                                    Result &MMIOFuncs) {
+  if (Scope.isEnabled()) {
+    // Only look at the callers of the findings, which are all in scope,
+    // instead of building the call graph of the whole module. Like the call
+    // graph's external node, an unknown caller may call externally visible
+    // functions.
+    for (auto &KV : MMIOFuncs) {
+      for (const User *U : KV.first->users()) {
+        auto *Call = dyn_cast<CallBase>(U);
+        if (!Call || Call->getCalledFunction() != KV.first ||
+            !isAppFunc(*Call->getFunction()))
+          continue;
+        KV.second.CalledByApp = true;
+        KV.second.Caller = Call->getFunction();
+      }
+      if (!KV.second.CalledByApp &&
+          (!KV.first->hasLocalLinkage() || KV.first->hasAddressTaken()))
+        KV.second.CalledByApp = true;
+    }
+    return;
+  }
+
+  const CallGraph &CG = GetCG();
+  LLVM_DEBUG(CG.print(dbgs()));
   for (auto &I : CG) {
     const Function *Caller = I.first;
     if (Caller && !isAppFunc(*Caller))
@@ -149,13 +250,116 @@ void FindMMIOFunc::checkCalledByApp(Module &M, Result &MMIOFuncs) {
   }
 }
 
-FindMMIOFunc::Result FindMMIOFunc::runOnModule(Module &M) {
+FindMMIOFunc::Result
+FindMMIOFunc::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                          CallGraphGetter GetCG,
+                          ReachabilityGetter GetReachable) {
   Result Res;
-  findNonHalMMIOFunc(M, Res);
-  checkCalledByApp(M, Res);
+  Classifier.configure();
+  if (isScanStatsEnabled())
+    Stats = std::make_unique<ScanStats>(Sites.Stats);
+  findNonHalMMIOFunc(M, Sites, Res);
+  checkCalledByApp(Sites.Scope, GetCG, Res);
+  if (Stream)
+    streamRefinements(Res, GetReachable());
+  if (!CacheFile.empty())
+    updateCache(M, Sites.Scope, Res);
+  if (Stats) {
+    Stats->print(errs());
+    Stats.reset();
+  }
   return Res;
 }
 
+void FindMMIOFunc::updateCache(Module &M, const ChangeScope &Scope,
+                               Result &MMIOFuncs) {
+  // The findings of the previous run, one function name per line
+  std::set<std::string> Cached;
+  auto Buf = MemoryBuffer::getFile(CacheFile);
+  if (Buf) {
+    SmallVector<StringRef, 64> Lines;
+    (*Buf)->getBuffer().split(Lines, '\n', -1, /*KeepEmpty=*/false);
+    for (StringRef Line : Lines)
+      Cached.insert(Line.str());
+  }
+
+  // Findings outside of the scope weren't recomputed: keep them
+  std::set<std::string> Updated;
+  if (Scope.isEnabled())
+    for (const std::string &Name : Cached) {
+      const Function *F = M.getFunction(Name);
+      if (!F || !Scope.contains(F))
+        Updated.insert(Name);
+    }
+  for (auto &KV : MMIOFuncs) {
+    if (!KV.second.CalledByApp)
+      continue;
+    std::string Name = KV.first->getName().str();
+    KV.second.New = Buf && !Cached.count(Name);
+    Updated.insert(Name);
+  }
+
+  std::error_code EC;
+  raw_fd_ostream OS(CacheFile, EC, sys::fs::OF_Text);
+  if (EC) {
+    errs() << "-mmio-cache: cannot write '" << CacheFile
+           << "': " << EC.message() << "\n";
+    return;
+  }
+  for (const std::string &Name : Updated)
+    OS << Name << "\n";
+}
+
+// Identifies the source site of a finding: the function's declaration (or
+// definition) and the location of the MMIO access. Every instantiation of a
+// template gets its own DISubprogram, but they all point to the same lines.
+using SourceSiteKey = std::tuple<StringRef, StringRef, unsigned, StringRef,
+                                 unsigned, unsigned>;
+
+static Optional<SourceSiteKey> getSourceSite(const Function &F,
+                                             const Instruction &MMIOIns) {
+  const DISubprogram *SP = F.getSubprogram();
+  const DebugLoc &Loc = MMIOIns.getDebugLoc();
+  if (!SP || !Loc)
+    return None;
+  if (const DISubprogram *Decl = SP->getDeclaration())
+    SP = Decl;
+  return SourceSiteKey(SP->getFilename(), SP->getDirectory(), SP->getLine(),
+                       cast<DIScope>(Loc.getScope())->getFilename(),
+                       Loc.getLine(), Loc.getCol());
+}
+
+std::vector<MMIOFuncGroup> foldInstantiations(const FindMMIOFunc::Result &Res,
+                                              bool AppOnly) {
+  std::vector<MMIOFuncGroup> Groups;
+  std::map<SourceSiteKey, size_t> GroupIds;
+  for (auto &KV : Res) {
+    if (AppOnly && !KV.second.CalledByApp)
+      continue;
+    Optional<SourceSiteKey> Key = getSourceSite(*KV.first, *KV.second.MMIOIns);
+    if (Key) {
+      auto Id = GroupIds.emplace(*Key, Groups.size());
+      if (!Id.second) {
+        Groups[Id.first->second].Instances.push_back(KV.first);
+        continue;
+      }
+    }
+    Groups.emplace_back();
+    Groups.back().Instances.push_back(KV.first);
+  }
+
+  auto ByName = [](const Function *A, const Function *B) {
+    return A->getName() < B->getName();
+  };
+  for (MMIOFuncGroup &G : Groups)
+    std::sort(G.Instances.begin(), G.Instances.end(), ByName);
+  std::sort(Groups.begin(), Groups.end(),
+            [&](const MMIOFuncGroup &A, const MMIOFuncGroup &B) {
+              return ByName(A.Instances[0], B.Instances[0]);
+            });
+  return Groups;
+}
+
 PreservedAnalyses FindMMIOFuncPrinter::run(Module &M,
                                            ModuleAnalysisManager &MAM) {
 
@@ -166,8 +370,16 @@ PreservedAnalyses FindMMIOFuncPrinter::run(Module &M,
 }
 
 FindMMIOFunc::Result FindMMIOFunc::run(llvm::Module &M,
-                                       llvm::ModuleAnalysisManager &) {
-  return runOnModule(M);
+                                       llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  return runOnModule(
+      M, Sites,
+      [&]() -> const CallGraph & {
+        return MAM.getResult<CallGraphAnalysis>(M);
+      },
+      [&]() -> const AppReachability::Result & {
+        return MAM.getResult<AppReachability>(M);
+      });
 }
 
 // bool LegacyFindMMIOFunc::runOnModule(llvm::Module &M) {
@@ -182,46 +394,9 @@ FindMMIOFunc::Result FindMMIOFunc::run(llvm::Module &M,
 //------------------------------------------------------------------------------
 // New PM Registration
 //------------------------------------------------------------------------------
+// The plugin entry point is in FindMMIOFuncPlugin.cpp
 AnalysisKey FindMMIOFunc::Key;
 
-llvm::PassPluginLibraryInfo getFindMMIOFuncPluginInfo() {
-  return {LLVM_PLUGIN_API_VERSION, "mmio-func", LLVM_VERSION_STRING,
-          [](PassBuilder &PB) {
-            // #1 REGISTRATION FOR "opt -passes=print<mmio-func>"
-            PB.registerPipelineParsingCallback(
-                [&](StringRef Name, ModulePassManager &MPM,
-                    ArrayRef<PassBuilder::PipelineElement>) {
-                  if (Name == "print<mmio-func>") {
-                    MPM.addPass(FindMMIOFuncPrinter(llvm::errs()));
-                    return true;
-                  }
-                  return false;
-                });
-            // #2 REGISTRATION FOR "MAM.getResult<FindMMIOFunc>(Module)"
-            PB.registerAnalysisRegistrationCallback(
-                [](ModuleAnalysisManager &MAM) {
-                  MAM.registerPass([&] { return FindMMIOFunc(); });
-                });
-          }};
-};
-
-extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
-llvmGetPassPluginInfo() {
-  return getFindMMIOFuncPluginInfo();
-}
-
-//------------------------------------------------------------------------------
-// Legacy PM Registration
-//------------------------------------------------------------------------------
-// char LegacyFindMMIOFunc::ID = 0;
-//
-//// #1 REGISTRATION FOR "opt -analyze -legacy-static-cc"
-// RegisterPass<LegacyFindMMIOFunc>
-//    X(/*PassArg=*/"legacy-static-cc",
-//      /*Name=*/"LegacyFindMMIOFunc",
-//      /*CFGOnly=*/true,
-//      /*is_analysis=*/true);
-
 //------------------------------------------------------------------------------
 // Helper functions
 //------------------------------------------------------------------------------
@@ -237,26 +412,34 @@ static void printMMIOFuncResult(raw_ostream &OutS,
   //  OutS << "-------------------------------------------------"
   //       << "\n";
   //
-  for (auto &KV : Res) {
-    if (!KV.second.CalledByApp)
-      continue;
-    OutS << KV.first->getName();
+  // Template instantiations with the same MMIO access are reported once
+  for (const MMIOFuncGroup &G : foldInstantiations(Res, /*AppOnly=*/true)) {
+    const Function *F = G.Instances[0];
+    const FindMMIOFunc::NonHalMMIOFunc &Info = Res.at(F);
+    OutS << F->getName();
     //DISubprogram *DISub = F.Func->getSubprogram();
     //if (DISub && DISub->getFile())
     //  OutS << " " << DISub->getFile()->getFilename();
-    const DebugLoc &DebugLoc = KV.second.MMIOIns->getDebugLoc();
+    const DebugLoc &DebugLoc = Info.MMIOIns->getDebugLoc();
     if (DebugLoc)
       OutS << "(" << cast<DIScope>(DebugLoc.getScope())->getFilename()
            << ":" << DebugLoc.getLine() << ":" << DebugLoc.getCol() << ")";
+    if (!Info.Peripheral.empty())
+      OutS << " [" << Info.Peripheral << "+0x"
+           << Twine::utohexstr(Info.Addr - Info.PeripheralBase) << "]";
     OutS << " called by ";
-    if (KV.second.Caller) {
-      OutS << KV.second.Caller->getName();
-      DISubprogram *DI = KV.second.Caller->getSubprogram();
+    if (Info.Caller) {
+      OutS << Info.Caller->getName();
+      DISubprogram *DI = Info.Caller->getSubprogram();
       if (DI && DI->getFile())
         OutS << "(" << DI->getFile()->getFilename() << ")";
     }
     else
       OutS << "external node";
+    if (G.Instances.size() > 1)
+      OutS << " [" << G.Instances.size() << " instantiations]";
+    if (Info.New)
+      OutS << " [new]";
     OutS << "\n";
   }
 
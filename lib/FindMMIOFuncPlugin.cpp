@@ -0,0 +1,74 @@
+//==============================================================================
+// FILE:
+//    FindMMIOFuncPlugin.cpp
+//
+// DESCRIPTION:
+//    The pass plugin entry point of libFindMMIOFunc: registers
+//    "print<mmio-func>", "print<mmio-sites>", "print<hal-coverage>" and
+//    "print<mmio-func-rule-sets>", and the AppReachability analysis. The
+//    analyses themselves live in FindMMIOFunc.cpp, FindMMIOSites.cpp,
+//    FindHALCoverage.cpp, FindRuleSets.cpp and AppReachability.cpp, which
+//    are also built into the HALBypass library (include/HALBypass.h).
+//
+// License: MIT
+//==============================================================================
+#include "AppReachability.h"
+#include "FindHALCoverage.h"
+#include "FindMMIOFunc.h"
+#include "FindRuleSets.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getFindMMIOFuncPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "mmio-func", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<mmio-func>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<mmio-func>") {
+                    MPM.addPass(FindMMIOFuncPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindMMIOFunc>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindMMIOFunc(); });
+                });
+            // "print<mmio-sites>" and the FindMMIOSites analysis
+            registerFindMMIOSites(PB);
+            // "print<hal-coverage>" and the FindHALCoverage analysis
+            registerFindHALCoverage(PB);
+            // "print<mmio-func-rule-sets>" and the FindRuleSets analysis
+            registerFindRuleSets(PB);
+            // The AppReachability analysis
+            registerAppReachability(PB);
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindMMIOFuncPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Legacy PM Registration
+//------------------------------------------------------------------------------
+// char LegacyFindMMIOFunc::ID = 0;
+//
+//// #1 REGISTRATION FOR "opt -analyze -legacy-static-cc"
+// RegisterPass<LegacyFindMMIOFunc>
+//    X(/*PassArg=*/"legacy-static-cc",
+//      /*Name=*/"LegacyFindMMIOFunc",
+//      /*CFGOnly=*/true,
+//      /*is_analysis=*/true);
@@ -0,0 +1,305 @@
+//==============================================================================
+// FILE:
+//    FindMMIOSites.cpp
+//
+// DESCRIPTION:
+//    Lists every load and store through a constant MMIO address, in all
+//    functions (HAL included). The address of an access is the constant base
+//    the pointer is cast from plus all constant offsets on the way, so that
+//    register accesses through a peripheral struct
+//
+//      NRF_UART0->ENABLE = 4;
+//        => store i32 4, i32* getelementptr (%struct.NRF_UART_Type,
+//             %struct.NRF_UART_Type* inttoptr (i32 1073750016 to ...), 0, 27)
+//
+//    are attributed to the register (0x40002500), not to the base.
+//
+//    Instructions that pass a constant MMIO address on, e.g. a call of a
+//    helper with &NRF_P0->OUT, are listed too (as inexact sites, see
+//    MMIOSite::AddressTaken): the function that takes the address is where
+//    the peripheral is picked, even if the helper does the access.
+//
+//    Constant addresses are collected first and classified in bulk with
+//    AddressClassifier::classify().
+//
+//    With -changed-files or -changed-from-git, only the functions touched by
+//    the change are scanned (see ChangeScope.h). With -mmio-scan-stats, the
+//    cost of scanning every function is recorded (see ScanStats.h).
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -passes="print<mmio-sites>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindMMIOSites.h"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/Support/Debug.h"
+
+using namespace llvm;
+
+#define DEBUG_TYPE "mmio-sites"
+
+// Pretty-prints the result of this analysis
+static void printMMIOSitesResult(llvm::raw_ostream &OutS,
+                                 const FindMMIOSites::Result &);
+
+//------------------------------------------------------------------------------
+// FindMMIOSites Implementation
+//------------------------------------------------------------------------------
+Optional<uint64_t> getConstantAddress(const Value *Ptr, const DataLayout &DL,
+                                      bool &Exact) {
+  Exact = true;
+  if (!Ptr->getType()->isPointerTy())
+    return None;
+  APInt Offset(DL.getIndexTypeSizeInBits(Ptr->getType()), 0);
+  // Bounded, constant expressions are never deeply nested in practice
+  for (unsigned Depth = 0; Depth < 8; ++Depth) {
+    Ptr = Ptr->stripAndAccumulateConstantOffsets(DL, Offset,
+                                                 /*AllowNonInbounds=*/true);
+    // inttoptr (i32 <addr> to T*), as a constant or an instruction
+    auto *Op = dyn_cast<Operator>(Ptr);
+    if (Op && Op->getOpcode() == Instruction::IntToPtr) {
+      auto *AddrCI = dyn_cast<ConstantInt>(Op->getOperand(0));
+      if (!AddrCI)
+        return None;
+      return AddrCI->getValue().getLimitedValue() +
+             Offset.getSExtValue();
+    }
+    // GEP with a variable index: fall back to its first element
+    auto *GEP = dyn_cast<GEPOperator>(Ptr);
+    if (!GEP)
+      return None;
+    Exact = false;
+    Ptr = GEP->getPointerOperand();
+  }
+  return None;
+}
+
+// The first constant address that I passes on, if any
+static Optional<uint64_t> getTakenAddress(const Instruction &I,
+                                          const DataLayout &DL) {
+  SmallVector<const Value *, 4> Ptrs;
+  if (auto *Call = dyn_cast<CallBase>(&I)) {
+    if (isa<DbgInfoIntrinsic>(Call))
+      return None;
+    Ptrs.append(Call->arg_begin(), Call->arg_end());
+  } else if (auto *SI = dyn_cast<StoreInst>(&I)) {
+    Ptrs.push_back(SI->getValueOperand());
+  } else if (auto *Ret = dyn_cast<ReturnInst>(&I)) {
+    if (Ret->getReturnValue())
+      Ptrs.push_back(Ret->getReturnValue());
+  }
+  bool Exact;
+  for (const Value *Ptr : Ptrs)
+    if (Optional<uint64_t> Addr = getConstantAddress(Ptr, DL, Exact))
+      return Addr;
+  return None;
+}
+
+ArrayRef<MMIOSite>
+FindMMIOSites::Result::getSites(const Function *F) const {
+  auto It = FuncSites.find(F);
+  if (It == FuncSites.end())
+    return {};
+  return makeArrayRef(Sites).slice(It->second.first,
+                                   It->second.second - It->second.first);
+}
+
+const MMIOSite *
+FindMMIOSites::Result::getSite(const Instruction *Ins) const {
+  auto It = InstSites.find(Ins);
+  return It == InstSites.end() ? nullptr : &Sites[It->second];
+}
+
+uint64_t FindMMIOSites::Result::getPeripheralBase(const MMIOSite &S) const {
+  if (const Region *P = getPeripheral(S))
+    return P->Begin;
+  return S.Addr & ~uint64_t(0xFFF);
+}
+
+std::string FindMMIOSites::Result::getPeripheralName(const MMIOSite &S) const {
+  if (const Region *P = getPeripheral(S))
+    return P->Name;
+  return "0x" + utohexstr(getPeripheralBase(S));
+}
+
+std::string FindMMIOSites::Result::getRegisterName(const MMIOSite &S) const {
+  uint64_t Offset = S.Addr - getPeripheralBase(S);
+  NRFRegister R = getNRFRegister(Offset);
+  std::string Name = getPeripheralName(S);
+  if (R != NRFRegister::Other)
+    Name = Name + "." + getNRFRegisterName(R);
+  bool Single = R != NRFRegister::Task && R != NRFRegister::Event &&
+                R != NRFRegister::Other;
+  if (!Single)
+    Name += "[0x" + utohexstr(Offset) + "]";
+  return Name;
+}
+
+FindMMIOSites::Result FindMMIOSites::runOnModule(Module &M) {
+  Addresses.configure();
+  const DataLayout &DL = M.getDataLayout();
+  Result Res;
+  Res.Scope.configure(M);
+
+  // 1. Collect every load/store through a constant address and every
+  // instruction that passes one on, and the distinct addresses
+  struct Candidate {
+    MMIOSite Site;
+    unsigned AddrId;
+  };
+  std::vector<Candidate> Candidates;
+  DenseMap<uint64_t, unsigned> AddrIds;
+  std::vector<uint64_t> Addrs;
+  bool CollectStats = isScanStatsEnabled();
+  for (auto &Func : M) {
+    if (!Res.Scope.contains(&Func))
+      continue;
+    uint64_t Start = CollectStats ? readCycleCounter() : 0;
+    uint64_t NumIns = 0;
+    for (auto &Ins : instructions(Func)) {
+      ++NumIns;
+      bool Exact = false;
+      Optional<uint64_t> Addr;
+      if (isa<LoadInst>(Ins) || isa<StoreInst>(Ins))
+        Addr = getConstantAddress(getPointerOperand(&Ins), DL, Exact);
+      bool AddressTaken = !Addr;
+      if (AddressTaken)
+        Addr = getTakenAddress(Ins, DL);
+      if (!Addr)
+        continue;
+      MMIOSite S{&Ins, *Addr, /*IsStore=*/false, /*Exact=*/false, AddressTaken,
+                 MMIOSite::NoPeripheral, None};
+      if (!AddressTaken) {
+        S.IsStore = isa<StoreInst>(Ins);
+        S.Exact = Exact;
+      }
+      if (auto *SI = dyn_cast<StoreInst>(&Ins))
+        if (auto *CI = dyn_cast<ConstantInt>(SI->getValueOperand()))
+          if (S.IsStore)
+            S.StoredValue = CI->getValue().getLimitedValue();
+      auto Id = AddrIds.try_emplace(*Addr, Addrs.size());
+      if (Id.second)
+        Addrs.push_back(*Addr);
+      Candidates.push_back({S, Id.first->second});
+    }
+    if (CollectStats && !Func.isDeclaration())
+      Res.Stats.addScan(Func, NumIns, readCycleCounter() - Start);
+  }
+
+  // 2. Classify all the addresses at once
+  std::vector<uint8_t> Verdicts(Addrs.size());
+  uint64_t Start = CollectStats ? readCycleCounter() : 0;
+  Addresses.classify(Addrs, Verdicts);
+  if (CollectStats)
+    Res.Stats.AddressCycles = readCycleCounter() - Start;
+
+  // 3. Keep the MMIO accesses, grouped by function
+  DenseMap<const Region *, unsigned> PeripheralIds;
+  for (Candidate &C : Candidates) {
+    if (!Verdicts[C.AddrId])
+      continue;
+    MMIOSite &S = C.Site;
+    LLVM_DEBUG({
+      dbgs() << *S.Ins << "\n";
+      dbgs() << "Addr: " << Twine::utohexstr(S.Addr) << "\n";
+      if (const DebugLoc &Debug = S.Ins->getDebugLoc())
+        dbgs() << *Debug << "\n";
+    });
+
+    if (const Region *P = Addresses.getPeripheral(S.Addr)) {
+      auto Id = PeripheralIds.try_emplace(P, Res.Peripherals.size());
+      if (Id.second)
+        Res.Peripherals.push_back(*P);
+      S.Peripheral = Id.first->second;
+    }
+
+    unsigned Idx = Res.Sites.size();
+    auto Range = Res.FuncSites.try_emplace(S.getFunction(), Idx, Idx);
+    Range.first->second.second = Idx + 1;
+    Res.InstSites[S.Ins] = Idx;
+    Res.Sites.push_back(S);
+  }
+  return Res;
+}
+
+FindMMIOSites::Result FindMMIOSites::run(llvm::Module &M,
+                                         llvm::ModuleAnalysisManager &) {
+  return runOnModule(M);
+}
+
+PreservedAnalyses FindMMIOSitesPrinter::run(Module &M,
+                                            ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+
+  printMMIOSitesResult(OS, Sites);
+  return PreservedAnalyses::all();
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindMMIOSites::Key;
+
+void registerFindMMIOSites(PassBuilder &PB) {
+  // #1 REGISTRATION FOR "opt -passes=print<mmio-sites>"
+  PB.registerPipelineParsingCallback(
+      [&](StringRef Name, ModulePassManager &MPM,
+          ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "print<mmio-sites>") {
+          MPM.addPass(FindMMIOSitesPrinter(llvm::errs()));
+          return true;
+        }
+        return false;
+      });
+  // #2 REGISTRATION FOR "MAM.getResult<FindMMIOSites>(Module)"
+  PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager &MAM) {
+    MAM.registerPass([&] { return FindMMIOSites(); });
+  });
+}
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+std::string getDebugLocString(const Instruction *Ins) {
+  const DebugLoc &Debug = Ins->getDebugLoc();
+  if (!Debug)
+    return "<no debug info>";
+  return (cast<DIScope>(Debug.getScope())->getFilename() + ":" +
+          Twine(Debug.getLine()) + ":" + Twine(Debug.getCol()))
+      .str();
+}
+
+static void printMMIOSitesResult(raw_ostream &OutS,
+                                 const FindMMIOSites::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: MMIO accesses\n";
+  OutS << "=================================================\n";
+  const Function *Last = nullptr;
+  for (const MMIOSite &S : Res.Sites) {
+    if (S.getFunction() != Last) {
+      Last = S.getFunction();
+      OutS << Last->getName() << "\n";
+    }
+    OutS << "  " << (S.IsStore ? "store" : S.AddressTaken ? "addr " : "load ")
+         << " 0x"
+         << Twine::utohexstr(S.Addr);
+    if (!S.Exact)
+      OutS << "[i]";
+    if (const Region *P = Res.getPeripheral(S))
+      OutS << " [" << P->Name << "+0x" << Twine::utohexstr(S.Addr - P->Begin)
+           << "]";
+    OutS << " (" << getDebugLocString(S.Ins) << ")\n";
+  }
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
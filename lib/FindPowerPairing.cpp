@@ -0,0 +1,328 @@
+//==============================================================================
+// FILE:
+//    FindPowerPairing.cpp
+//
+// DESCRIPTION:
+//    Finds peripherals that are switched on and never switched off again,
+//    which keeps them (and their clocks) drawing current. Using the nRF5x
+//    register layout, a peripheral is
+//      * enabled by a non-zero store to ENABLE (0x500) and disabled by a
+//        zero store to it, or
+//      * started and stopped by writing 1 to its start and stop tasks.
+//        Their offsets depend on the peripheral type: TASKS_START (0x000)
+//        and TASKS_STOP (0x004) on TIMER, RTC, RNG, TEMP, PDM, ..., but
+//        e.g. START (0x000) and STOP (0x008) on SAADC, where 0x004 is
+//        SAMPLE. The type comes from the devicetree label of the
+//        peripheral, or else from the nRF52 base address. The tasks of
+//        other peripherals (GPIOTE, PPI, ...) are ignored, only their
+//        ENABLE is checked.
+//
+//    For every enable reachable from an application root (main, RTOS tasks,
+//    ISRs), a disable of the same peripheral must be able to run after it:
+//    later in the same function (directly or in a callee), or after the
+//    function returns, in one of its callers. Enables without one are
+//    reported, with the enables made by HAL bypasses flagged.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindPowerPairing.so `\`
+//        -passes="print<power-pairing>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindPowerPairing.h"
+#include "CallPaths.h"
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Debug.h"
+#include <set>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "power-pairing"
+
+// Pretty-prints the result of this analysis
+static void printPowerPairingResult(llvm::raw_ostream &OutS,
+                                    const FindPowerPairing::Result &);
+
+//------------------------------------------------------------------------------
+// FindPowerPairing Implementation
+//------------------------------------------------------------------------------
+enum class PowerEffect { None, On, Off };
+
+// The bit of the task register at Offset in a task mask
+static constexpr uint64_t task(unsigned Offset) {
+  return uint64_t(1) << (Offset / 4);
+}
+
+// The tasks that start and stop a type of nRF5x peripheral
+struct PowerTasks {
+  const char *Type;
+  uint64_t Start;
+  uint64_t Stop;
+};
+
+static const PowerTasks PowerTaskTable[] = {
+    // TXEN, RXEN / DISABLE
+    {"radio", task(0x000) | task(0x004), task(0x010)},
+    // STARTRX, STARTTX / STOPRX, STOPTX (UART and UARTE)
+    {"uart", task(0x000) | task(0x008), task(0x004) | task(0x00C)},
+    // SPI(M/S) and TWI(M/S) instances share their base addresses: TWI
+    // STARTRX, STARTTX and SPIM START / STOP of both
+    {"serial", task(0x000) | task(0x008) | task(0x010), task(0x014)},
+    // ACTIVATE / DISABLE
+    {"nfct", task(0x000), task(0x004)},
+    // START / STOP, 0x004 is SAMPLE
+    {"saadc", task(0x000), task(0x008)},
+    // START / STOP, SHUTDOWN
+    {"timer", task(0x000), task(0x004) | task(0x010)},
+    {"rtc", task(0x000), task(0x004)},
+    {"temp", task(0x000), task(0x004)},
+    {"rng", task(0x000), task(0x004)},
+    {"ecb", task(0x000), task(0x004)},
+    // CCM KSGEN, CRYPT and AAR START / STOP, at the same base
+    {"ccm", task(0x000) | task(0x004), task(0x008)},
+    {"qdec", task(0x000), task(0x004)},
+    {"comp", task(0x000), task(0x004)},
+    // SEQSTART[0], SEQSTART[1] / STOP
+    {"pwm", task(0x008) | task(0x00C), task(0x004)},
+    {"pdm", task(0x000), task(0x004)},
+    {"i2s", task(0x000), task(0x004)},
+    // ACTIVATE / DEACTIVATE
+    {"qspi", task(0x000), task(0x010)},
+};
+
+// The peripherals of the nRF52832 and nRF52840 by base address
+static const std::pair<uint64_t, const char *> PowerTaskBases[] = {
+    {0x40001000, "radio"}, {0x40002000, "uart"},  {0x40003000, "serial"},
+    {0x40004000, "serial"}, {0x40005000, "nfct"}, {0x40007000, "saadc"},
+    {0x40008000, "timer"}, {0x40009000, "timer"}, {0x4000A000, "timer"},
+    {0x4000B000, "rtc"},   {0x4000C000, "temp"},  {0x4000D000, "rng"},
+    {0x4000E000, "ecb"},   {0x4000F000, "ccm"},   {0x40011000, "rtc"},
+    {0x40012000, "qdec"},  {0x40013000, "comp"},  {0x4001A000, "timer"},
+    {0x4001B000, "timer"}, {0x4001C000, "pwm"},   {0x4001D000, "pdm"},
+    {0x40021000, "pwm"},   {0x40022000, "pwm"},   {0x40023000, "serial"},
+    {0x40024000, "rtc"},   {0x40025000, "i2s"},   {0x40028000, "uart"},
+    {0x40029000, "qspi"},  {0x4002D000, "pwm"},   {0x4002F000, "serial"},
+};
+
+static const PowerTasks *findPowerTasks(StringRef Type) {
+  for (const PowerTasks &T : PowerTaskTable)
+    if (Type == T.Type)
+      return &T;
+  return nullptr;
+}
+
+// The peripheral type of a devicetree label or node name, e.g. "&timer1" or
+// "adc@40007000" (the Zephyr names)
+static StringRef getTypeByName(StringRef Name) {
+  Name = Name.ltrim('&').split('@').first.rtrim("0123456789_");
+  return StringSwitch<StringRef>(Name)
+      .Case("uarte", "uart")
+      .Cases("spi", "spim", "spis", "i2c", "twi", "twim", "twis", "serial")
+      .Case("adc", "saadc")
+      .Case("aar", "ccm")
+      .Case("lpcomp", "comp")
+      .Default(Name);
+}
+
+static const PowerTasks *getPowerTasks(const MMIOSite &S,
+                                       const FindMMIOSites::Result &Sites) {
+  if (const Region *P = Sites.getPeripheral(S))
+    if (const PowerTasks *T = findPowerTasks(getTypeByName(P->Name)))
+      return T;
+  uint64_t Base = Sites.getPeripheralBase(S);
+  for (const auto &B : PowerTaskBases)
+    if (B.first == Base)
+      return findPowerTasks(B.second);
+  return nullptr;
+}
+
+static PowerEffect getPowerEffect(const MMIOSite &S,
+                                  const FindMMIOSites::Result &Sites) {
+  if (!S.IsStore || !S.Exact)
+    return PowerEffect::None;
+  NRFRegister R = Sites.getRegister(S);
+  if (R == NRFRegister::Enable)
+    return S.StoredValue && *S.StoredValue == 0 ? PowerEffect::Off
+                                                : PowerEffect::On;
+  // Writing 0 to a task register does nothing
+  if (R != NRFRegister::Task || !S.StoredValue || *S.StoredValue != 1)
+    return PowerEffect::None;
+  // Unknown peripherals are only switched by ENABLE
+  const PowerTasks *T = getPowerTasks(S, Sites);
+  if (!T)
+    return PowerEffect::None;
+  uint64_t Bit = task(S.Addr - Sites.getPeripheralBase(S));
+  if (T->Start & Bit)
+    return PowerEffect::On;
+  if (T->Stop & Bit)
+    return PowerEffect::Off;
+  return PowerEffect::None;
+}
+
+bool FindPowerPairing::mayDisable(const Function *F, uint64_t Base) {
+  auto It = Disables.find({F, Base});
+  if (It != Disables.end())
+    return It->second;
+  bool Res = false;
+  CallPaths Reachable(*CG, F);
+  for (const Function *G : Reachable.functions())
+    for (const MMIOSite &S : Sites->getSites(G))
+      if (getPowerEffect(S, *Sites) == PowerEffect::Off &&
+          Sites->getPeripheralBase(S) == Base)
+        Res = true;
+  Disables[{F, Base}] = Res;
+  return Res;
+}
+
+bool FindPowerPairing::isDisabledAfter(const Instruction *From, uint64_t Base,
+                                       unsigned Depth) {
+  auto DisablesAt = [&](const Instruction &I) {
+    if (const MMIOSite *S = Sites->getSite(&I))
+      return getPowerEffect(*S, *Sites) == PowerEffect::Off &&
+             Sites->getPeripheralBase(*S) == Base;
+    auto *Call = dyn_cast<CallBase>(&I);
+    const Function *Callee = Call ? Call->getCalledFunction() : nullptr;
+    return Callee && !Callee->isDeclaration() && mayDisable(Callee, Base);
+  };
+
+  // 1. The rest of the function, following the CFG
+  const BasicBlock *Start = From->getParent();
+  for (const Instruction *I = From->getNextNode(); I; I = I->getNextNode())
+    if (DisablesAt(*I))
+      return true;
+  SmallVector<const BasicBlock *, 8> Worklist(succ_begin(Start),
+                                              succ_end(Start));
+  SmallPtrSet<const BasicBlock *, 16> Visited;
+  while (!Worklist.empty()) {
+    const BasicBlock *BB = Worklist.pop_back_val();
+    if (!Visited.insert(BB).second)
+      continue;
+    for (const Instruction &I : *BB)
+      if (DisablesAt(I))
+        return true;
+    Worklist.append(succ_begin(BB), succ_end(BB));
+  }
+
+  // 2. The callers, after the call returns
+  if (Depth >= 8)
+    return false;
+  const Function *F = From->getFunction();
+  for (const User *U : F->users()) {
+    auto *Call = dyn_cast<CallBase>(U);
+    if (Call && Call->getCalledFunction() == F &&
+        isDisabledAfter(Call, Base, Depth + 1))
+      return true;
+  }
+  return false;
+}
+
+FindPowerPairing::Result
+FindPowerPairing::runOnModule(Module &M, const FindMMIOSites::Result &S,
+                              const FindMMIOFunc::Result &MMIOFuncs,
+                              const CallGraph &Graph,
+                              const AppReachability::Result &Reachable) {
+  Result Res;
+  Sites = &S;
+  CG = &Graph;
+
+  const CallPaths &Paths = Reachable.App;
+  std::set<uint64_t> Reported;
+  for (const Function *F : Paths.functions())
+    for (const MMIOSite &Enable : Sites->getSites(F)) {
+      if (getPowerEffect(Enable, *Sites) != PowerEffect::On)
+        continue;
+      uint64_t Base = Sites->getPeripheralBase(Enable);
+      if (Reported.count(Enable.Addr) || isDisabledAfter(Enable.Ins, Base, 0))
+        continue;
+      Reported.insert(Enable.Addr);
+      LLVM_DEBUG(dbgs() << "Unpaired enable: " << *Enable.Ins << "\n");
+      Res.push_back({&Enable, Sites->getRegisterName(Enable),
+                     Sites->getPeripheralName(Enable), Paths.getPath(F),
+                     MMIOFuncs.count(F) != 0});
+    }
+  return Res;
+}
+
+PreservedAnalyses FindPowerPairingPrinter::run(Module &M,
+                                               ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindPowerPairing>(M);
+
+  printPowerPairingResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindPowerPairing::Result
+FindPowerPairing::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &Funcs = MAM.getResult<FindMMIOFunc>(M);
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  auto &Reachable = MAM.getResult<AppReachability>(M);
+  return runOnModule(M, Sites, Funcs, CG, Reachable);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindPowerPairing::Key;
+
+llvm::PassPluginLibraryInfo getFindPowerPairingPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "power-pairing", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<power-pairing>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<power-pairing>") {
+                    MPM.addPass(FindPowerPairingPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindPowerPairing>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindPowerPairing(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindPowerPairingPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printPowerPairingResult(raw_ostream &OutS,
+                                    const FindPowerPairing::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Peripherals never disabled\n";
+  OutS << "=================================================\n";
+  for (const auto &U : Res) {
+    OutS << U.Peripheral << ": " << U.Register << " written in "
+         << U.Enable->getFunction()->getName() << " at "
+         << getDebugLocString(U.Enable->Ins);
+    if (U.HALBypass)
+      OutS << " [HAL bypass]";
+    OutS << "\n    via ";
+    for (size_t I = 0; I < U.Path.size(); ++I)
+      OutS << (I ? " -> " : "") << U.Path[I]->getName();
+    OutS << "\n";
+  }
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
@@ -0,0 +1,414 @@
+//==============================================================================
+// FILE:
+//    FindRedundantWrites.cpp
+//
+// DESCRIPTION:
+//    Finds MMIO stores that write a register with the constant it already
+//    holds, e.g. configuration registers rewritten by a repeated init().
+//    Every such store is a wasted bus transaction, and some peripherals
+//    restart when their configuration is written.
+//
+//    A forward dataflow analysis tracks the constant each register is known
+//    to hold on every path (TASKS and EVENTS registers are triggers and
+//    hardware-owned, so they're not tracked). Calls are handled through
+//    per-function summaries: the registers a function may write, and the
+//    constants it leaves in them on every path. A call is redundant for a
+//    register if the callee always leaves the value the register already
+//    holds, as in
+//
+//      uart_init(); ... uart_init();
+//
+//    Stores and calls in loops that are the only write to a register in the
+//    loop are reported too: every iteration after the first rewrites the
+//    same value.
+//
+//    Calls to functions without a body (other than delays) are assumed to
+//    possibly write any register.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindRedundantWrites.so `\`
+//        -passes="print<redundant-writes>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindRedundantWrites.h"
+#include "CostModel.h"
+
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include <algorithm>
+
+using namespace llvm;
+
+using State = FindRedundantWrites::State;
+using Summary = FindRedundantWrites::Summary;
+
+// Pretty-prints the result of this analysis
+static void printRedundantWritesResult(llvm::raw_ostream &OutS,
+                                       const FindRedundantWrites::Result &);
+
+//------------------------------------------------------------------------------
+// FindRedundantWrites Implementation
+//------------------------------------------------------------------------------
+// TASKS and EVENTS registers don't hold a configuration
+static bool isTracked(const MMIOSite &S, const FindMMIOSites::Result &Sites) {
+  NRFRegister R = Sites.getRegister(S);
+  return S.Exact && R != NRFRegister::Task && R != NRFRegister::Event;
+}
+
+// The callee of a call that may write registers, or null if the call can't
+// write registers. Sets Unknown for calls to unknown code.
+static const Function *getWritingCallee(const CallBase &Call, bool &Unknown) {
+  Unknown = false;
+  if (Call.isInlineAsm() || CostModel::getDelayUs(Call))
+    return nullptr;
+  const Function *Callee = Call.getCalledFunction();
+  if (!Callee) {
+    Unknown = true;
+    return nullptr;
+  }
+  return Callee->isIntrinsic() ? nullptr : Callee;
+}
+
+// Keeps the registers known to hold the same value in both states
+static State meet(const State &A, const State &B) {
+  State Res;
+  for (const auto &KV : A) {
+    auto It = B.find(KV.first);
+    if (It != B.end() && It->second.Value == KV.second.Value)
+      Res.insert(KV);
+  }
+  return Res;
+}
+
+static bool sameValues(const State &A, const State &B) {
+  return A.size() == B.size() &&
+         std::equal(A.begin(), A.end(), B.begin(),
+                    [](const State::value_type &X, const State::value_type &Y) {
+                      return X.first == Y.first &&
+                             X.second.Value == Y.second.Value;
+                    });
+}
+
+const Summary &FindRedundantWrites::getSummary(const Function &F) {
+  auto It = Summaries.find(&F);
+  if (It != Summaries.end())
+    return *It->second;
+  // Recursive calls see a pessimistic summary
+  auto Placeholder = std::make_unique<Summary>();
+  Placeholder->WritesAll = true;
+  Summaries[&F] = std::move(Placeholder);
+
+  auto Sum = std::make_unique<Summary>();
+  if (F.isDeclaration()) {
+    Sum->WritesAll = true;
+  } else {
+    for (const Instruction &I : instructions(F)) {
+      if (const MMIOSite *S = Sites->getSite(&I)) {
+        if (S->IsStore && S->Exact)
+          Sum->Writes.insert(S->Addr);
+        else if (S->IsStore || S->AddressTaken)
+          Sum->WrittenPeripherals.insert(Sites->getPeripheralBase(*S));
+        if (!S->AddressTaken)
+          continue;
+      }
+      auto *Call = dyn_cast<CallBase>(&I);
+      if (!Call)
+        continue;
+      bool Unknown;
+      const Function *Callee = getWritingCallee(*Call, Unknown);
+      Sum->WritesAll |= Unknown;
+      if (!Callee || Callee == &F)
+        continue;
+      const Summary &CalleeSum = getSummary(*Callee);
+      Sum->WritesAll |= CalleeSum.WritesAll;
+      Sum->Writes.insert(CalleeSum.Writes.begin(), CalleeSum.Writes.end());
+      Sum->WrittenPeripherals.insert(CalleeSum.WrittenPeripherals.begin(),
+                                     CalleeSum.WrittenPeripherals.end());
+    }
+    Sum->Exit = analyze(F, nullptr);
+  }
+  Summaries[&F] = std::move(Sum);
+  return *Summaries[&F];
+}
+
+void FindRedundantWrites::transfer(const Instruction &I, State &S,
+                                   Result *Report) {
+  auto KillPeripheral = [&](const MMIOSite &Site) {
+    uint64_t Base = Sites->getPeripheralBase(Site);
+    for (auto It = S.begin(); It != S.end();)
+      It = Sites->getPeripheralBase(*It->second.Site) == Base ? S.erase(It)
+                                                             : std::next(It);
+  };
+  const MMIOSite *Site = Sites->getSite(&I);
+  // Whoever gets a passed on address may write any register of the
+  // peripheral. If I is a call, the callee is handled below.
+  if (Site && Site->AddressTaken) {
+    KillPeripheral(*Site);
+    Site = nullptr;
+  }
+  if (Site) {
+    if (!Site->IsStore)
+      return;
+    if (!Site->Exact) {
+      KillPeripheral(*Site);
+      return;
+    }
+    if (!isTracked(*Site, *Sites))
+      return;
+    if (!Site->StoredValue) {
+      S.erase(Site->Addr);
+      return;
+    }
+    auto It = S.find(Site->Addr);
+    if (Report && It != S.end() && It->second.Value == *Site->StoredValue)
+      Report->push_back({&I, Site->Addr, Sites->getRegisterName(*Site),
+                         *Site->StoredValue, It->second.Writer, false});
+    S[Site->Addr] = {*Site->StoredValue, Site, &I};
+    return;
+  }
+
+  auto *Call = dyn_cast<CallBase>(&I);
+  if (!Call)
+    return;
+  bool Unknown;
+  const Function *Callee = getWritingCallee(*Call, Unknown);
+  if (Unknown)
+    S.clear();
+  if (!Callee)
+    return;
+  const Summary &Sum = getSummary(*Callee);
+  if (Report)
+    for (const auto &KV : Sum.Exit) {
+      auto It = S.find(KV.first);
+      if (It != S.end() && It->second.Value == KV.second.Value)
+        Report->push_back({&I, KV.first,
+                           Sites->getRegisterName(*KV.second.Site),
+                           KV.second.Value, It->second.Writer, false});
+    }
+  if (Sum.WritesAll) {
+    S.clear();
+  } else {
+    for (auto It = S.begin(); It != S.end();) {
+      bool Killed =
+          Sum.Writes.count(It->first) ||
+          Sum.WrittenPeripherals.count(
+              Sites->getPeripheralBase(*It->second.Site));
+      It = Killed ? S.erase(It) : std::next(It);
+    }
+  }
+  for (const auto &KV : Sum.Exit)
+    S[KV.first] = {KV.second.Value, KV.second.Site, &I};
+}
+
+State FindRedundantWrites::analyze(const Function &F, Result *Report) {
+  ReversePostOrderTraversal<const Function *> RPOT(&F);
+  DenseMap<const BasicBlock *, State> Out;
+
+  // The state on entry to BB, or None if no predecessor has been visited
+  auto GetIn = [&](const BasicBlock *BB) -> Optional<State> {
+    if (BB->isEntryBlock())
+      return State();
+    Optional<State> In;
+    for (const BasicBlock *Pred : predecessors(BB)) {
+      auto It = Out.find(Pred);
+      if (It == Out.end())
+        continue;
+      In = In ? meet(*In, It->second) : It->second;
+    }
+    return In;
+  };
+
+  for (bool Changed = true; Changed;) {
+    Changed = false;
+    for (const BasicBlock *BB : RPOT) {
+      Optional<State> In = GetIn(BB);
+      if (!In)
+        continue;
+      for (const Instruction &I : *BB)
+        transfer(I, *In, nullptr);
+      auto It = Out.find(BB);
+      if (It == Out.end() || !sameValues(It->second, *In)) {
+        Out[BB] = std::move(*In);
+        Changed = true;
+      }
+    }
+  }
+
+  Optional<State> Exit;
+  for (const BasicBlock *BB : RPOT) {
+    if (Report)
+      if (Optional<State> In = GetIn(BB))
+        for (const Instruction &I : *BB)
+          transfer(I, *In, Report);
+    auto It = Out.find(BB);
+    if (isa<ReturnInst>(BB->getTerminator()) && It != Out.end())
+      Exit = Exit ? meet(*Exit, It->second) : It->second;
+  }
+  return Exit ? *Exit : State();
+}
+
+void FindRedundantWrites::findLoopWrites(const Function &F, Result &Report) {
+  // The analyses below need a non-const function, but don't modify it
+  Function &MutF = const_cast<Function &>(F);
+  DominatorTree DT(MutF);
+  LoopInfo LI(DT);
+
+  for (const Loop *L : LI.getLoopsInPreorder()) {
+    struct Writer {
+      const Instruction *Ins;
+      const MMIOSite *Site;
+      Optional<uint64_t> Value;
+    };
+    std::map<uint64_t, std::vector<Writer>> Writers;
+    DenseSet<uint64_t> Peripherals;
+    bool WritesAll = false;
+    for (const BasicBlock *BB : L->blocks())
+      for (const Instruction &I : *BB) {
+        if (const MMIOSite *S = Sites->getSite(&I)) {
+          if (S->IsStore && S->Exact)
+            Writers[S->Addr].push_back({&I, S, S->StoredValue});
+          else if (S->IsStore || S->AddressTaken)
+            Peripherals.insert(Sites->getPeripheralBase(*S));
+          if (!S->AddressTaken)
+            continue;
+        }
+        auto *Call = dyn_cast<CallBase>(&I);
+        if (!Call)
+          continue;
+        bool Unknown;
+        const Function *Callee = getWritingCallee(*Call, Unknown);
+        WritesAll |= Unknown;
+        if (!Callee)
+          continue;
+        const Summary &Sum = getSummary(*Callee);
+        WritesAll |= Sum.WritesAll;
+        Peripherals.insert(Sum.WrittenPeripherals.begin(),
+                           Sum.WrittenPeripherals.end());
+        for (uint64_t Addr : Sum.Writes) {
+          auto Exit = Sum.Exit.find(Addr);
+          if (Exit == Sum.Exit.end())
+            Writers[Addr].push_back({&I, nullptr, None});
+          else
+            Writers[Addr].push_back({&I, Exit->second.Site,
+                                     Exit->second.Value});
+        }
+      }
+    if (WritesAll)
+      continue;
+
+    for (const auto &KV : Writers) {
+      const Writer &W = KV.second.front();
+      if (KV.second.size() != 1 || !W.Value || !isTracked(*W.Site, *Sites) ||
+          Peripherals.count(Sites->getPeripheralBase(*W.Site)))
+        continue;
+      bool Reported = std::any_of(
+          Report.begin(), Report.end(), [&](const RedundantWrite &R) {
+            return R.Ins == W.Ins && R.Addr == KV.first;
+          });
+      if (!Reported)
+        Report.push_back({W.Ins, KV.first, Sites->getRegisterName(*W.Site),
+                          *W.Value, nullptr, true});
+    }
+  }
+}
+
+FindRedundantWrites::Result
+FindRedundantWrites::runOnModule(Module &M, const FindMMIOSites::Result &S) {
+  Result Res;
+  Sites = &S;
+  Summaries.clear();
+  for (const Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    analyze(F, &Res);
+    findLoopWrites(F, Res);
+  }
+  return Res;
+}
+
+PreservedAnalyses FindRedundantWritesPrinter::run(Module &M,
+                                                  ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindRedundantWrites>(M);
+
+  printRedundantWritesResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindRedundantWrites::Result
+FindRedundantWrites::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  return runOnModule(M, Sites);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindRedundantWrites::Key;
+
+llvm::PassPluginLibraryInfo getFindRedundantWritesPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "redundant-writes", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<redundant-writes>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<redundant-writes>") {
+                    MPM.addPass(FindRedundantWritesPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindRedundantWrites>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindRedundantWrites(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindRedundantWritesPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printRedundantWritesResult(raw_ostream &OutS,
+                                       const FindRedundantWrites::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Redundant MMIO writes\n";
+  OutS << "=================================================\n";
+  for (const auto &W : Res) {
+    OutS << W.Ins->getFunction()->getName() << ": ";
+    if (auto *Call = dyn_cast<CallBase>(W.Ins))
+      OutS << "call to " << Call->getCalledFunction()->getName()
+           << " rewrites ";
+    else
+      OutS << "rewrites ";
+    OutS << W.Register << " = 0x" << Twine::utohexstr(W.Value) << " at "
+         << getDebugLocString(W.Ins);
+    if (W.InLoop)
+      OutS << " on every loop iteration";
+    else
+      OutS << ", already written at " << getDebugLocString(W.Previous);
+    OutS << "\n";
+  }
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
@@ -0,0 +1,282 @@
+//==============================================================================
+// FILE:
+//    FindRuleSets.cpp
+//
+// DESCRIPTION:
+//    Checks a module against several layer rule sets (e.g. a strict one, a
+//    legacy-tolerant one and one per team) in a single run. Every rule set
+//    is a file with the layer options of the command line, one per line:
+//
+//      # strict.rules
+//      path-layer=src/drivers=hal,src=app
+//      symbol-layer=nrf_=hal
+//
+//    and they are given together, optionally named:
+//
+//      -rule-sets=strict=strict.rules,legacy=legacy.rules,team-a.rules
+//
+//    The MMIO scan (FindMMIOSites) and the call graph are shared. Every
+//    function is classified under all rule sets at once into bit masks (bit
+//    I for rule set I), falling back to the built-in heuristics of
+//    FindMMIOFunc for the rule sets that don't classify it; those are
+//    evaluated once per function. The "called by the application" check of
+//    FindMMIOFunc then ORs the application mask of every caller into its
+//    callees, so all rule sets go over the call graph together. Bit I of the
+//    result is what FindMMIOFunc reports with rule set I on the command
+//    line.
+//
+// USAGE:
+//      opt -load libFindMMIOFunc.so -load-pass-plugin libFindMMIOFunc.so `\`
+//        -passes="print<mmio-func-rule-sets>" -rule-sets=<[name=]file,...> `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindRuleSets.h"
+#include "FindMMIOFunc.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+
+using namespace llvm;
+
+static cl::list<std::string>
+    RuleSetFiles("rule-sets",
+                 cl::desc("Layer rule set files to check the module against "
+                          "at once ([<name>=]<file>)"),
+                 cl::value_desc("file"), cl::CommaSeparated, cl::ZeroOrMore);
+
+bool hasRuleSets() { return !RuleSetFiles.empty(); }
+
+// Pretty-prints the result of this analysis
+static void printRuleSetsResult(llvm::raw_ostream &OutS,
+                                const FindRuleSets::Result &);
+
+//------------------------------------------------------------------------------
+// FindRuleSets Implementation
+//------------------------------------------------------------------------------
+void FindRuleSets::configure(Result &Res) {
+  for (StringRef Arg : RuleSetFiles) {
+    if (Res.Names.size() == MaxRuleSets) {
+      errs() << "-rule-sets: only " << MaxRuleSets
+             << " rule sets are supported, ignoring the rest\n";
+      break;
+    }
+    // "strict=strict.rules", or just "strict.rules"
+    StringRef Name, Path;
+    std::tie(Name, Path) = Arg.split('=');
+    if (Path.empty()) {
+      Path = Name;
+      Name = sys::path::stem(Path);
+    }
+
+    Expected<LayerRules> Rules = LayerRules::load(Path);
+    if (!Rules) {
+      logAllUnhandledErrors(Rules.takeError(), errs(), "-rule-sets: ");
+      continue;
+    }
+    Classifiers.push_back(std::make_unique<LayerClassifier>());
+    Classifiers.back()->configure(*Rules);
+    Res.Names.push_back(Name.str());
+  }
+}
+
+const FindRuleSets::LayerMasks &FindRuleSets::classify(const Function &F) {
+  auto Ins = Masks.try_emplace(&F);
+  LayerMasks &LM = Ins.first->second;
+  if (!Ins.second)
+    return LM;
+
+  RuleSetMask Unknown = 0;
+  for (unsigned I = 0, E = Classifiers.size(); I != E; ++I) {
+    RuleSetMask Bit = RuleSetMask(1) << I;
+    switch (Classifiers[I]->classify(F)) {
+    case Layer::HAL:
+      LM.HAL |= Bit;
+      break;
+    case Layer::App:
+      LM.App |= Bit;
+      break;
+    case Layer::ThirdParty:
+      break;
+    case Layer::Unknown:
+      Unknown |= Bit;
+      break;
+    }
+  }
+  // The heuristics don't depend on the rules: evaluate them once for all
+  // the rule sets that need them
+  if (Unknown) {
+    if (isHalByName(F))
+      LM.HAL |= Unknown;
+    if (mayBeAppByPath(F))
+      LM.App |= Unknown;
+  }
+  return LM;
+}
+
+void FindRuleSets::checkCalledByApp(const ChangeScope &Scope,
+                                    FindMMIOFunc::CallGraphGetter GetCG,
+                                    Result &Res) {
+  DenseMap<const Function *, unsigned> Index;
+  for (unsigned I = 0, E = Res.Findings.size(); I != E; ++I)
+    Index[Res.Findings[I].Func] = I;
+
+  if (Scope.isEnabled()) {
+    // Same as FindMMIOFunc::checkCalledByApp: only the direct callers, and
+    // unknown callers for externally visible functions
+    for (Finding &Fn : Res.Findings) {
+      for (const User *U : Fn.Func->users()) {
+        auto *Call = dyn_cast<CallBase>(U);
+        if (Call && Call->getCalledFunction() == Fn.Func)
+          Fn.CalledByApp |= classify(*Call->getFunction()).App;
+      }
+      if (!Fn.Func->hasLocalLinkage() || Fn.Func->hasAddressTaken())
+        Fn.CalledByApp = Res.getAll();
+    }
+    return;
+  }
+
+  RuleSetMask All = Res.getAll();
+  const CallGraph &CG = GetCG();
+  for (auto &I : CG) {
+    // The external node may be application code under every rule set
+    const Function *Caller = I.first;
+    RuleSetMask CallerApp = Caller ? classify(*Caller).App : All;
+    if (!CallerApp)
+      continue;
+    for (auto &J : *I.second) {
+      auto It = Index.find(J.second->getFunction());
+      if (It != Index.end())
+        Res.Findings[It->second].CalledByApp |= CallerApp;
+    }
+  }
+}
+
+FindRuleSets::Result
+FindRuleSets::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                          FindMMIOFunc::CallGraphGetter GetCG) {
+  Result Res;
+  Classifiers.clear();
+  Masks.clear();
+  configure(Res);
+  if (Classifiers.empty())
+    return Res;
+
+  for (const Function &F : M) {
+    ArrayRef<MMIOSite> FuncSites = Sites.getSites(&F);
+    if (FuncSites.empty())
+      continue;
+    RuleSetMask NonHAL = ~classify(F).HAL & Res.getAll();
+    if (NonHAL)
+      Res.Findings.push_back({&F, &FuncSites.front(), NonHAL});
+  }
+  checkCalledByApp(Sites.Scope, GetCG, Res);
+  return Res;
+}
+
+FindRuleSets::Result FindRuleSets::run(llvm::Module &M,
+                                       llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  return runOnModule(M, Sites, [&]() -> const CallGraph & {
+    return MAM.getResult<CallGraphAnalysis>(M);
+  });
+}
+
+PreservedAnalyses FindRuleSetsPrinter::run(Module &M,
+                                           ModuleAnalysisManager &MAM) {
+  auto &Res = MAM.getResult<FindRuleSets>(M);
+
+  printRuleSetsResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindRuleSets::Key;
+
+void registerFindRuleSets(PassBuilder &PB) {
+  // #1 REGISTRATION FOR "opt -passes=print<mmio-func-rule-sets>"
+  PB.registerPipelineParsingCallback(
+      [&](StringRef Name, ModulePassManager &MPM,
+          ArrayRef<PassBuilder::PipelineElement>) {
+        if (Name == "print<mmio-func-rule-sets>") {
+          MPM.addPass(FindRuleSetsPrinter(llvm::errs()));
+          return true;
+        }
+        return false;
+      });
+  // #2 REGISTRATION FOR "MAM.getResult<FindRuleSets>(Module)"
+  PB.registerAnalysisRegistrationCallback([](ModuleAnalysisManager &MAM) {
+    MAM.registerPass([&] { return FindRuleSets(); });
+  });
+}
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printRuleSetsResult(raw_ostream &OutS,
+                                const FindRuleSets::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Non-hal MMIO functions per rule set\n";
+  OutS << "=================================================\n";
+  if (Res.Names.empty()) {
+    OutS << "No rule sets, pass them with -rule-sets=<[name=]file,...>\n";
+    OutS << "-------------------------------------------------"
+         << "\n\n";
+    return;
+  }
+
+  // Fold the template instantiations like print<mmio-func> does. A group is
+  // flagged by the rule sets that flag any of its instances.
+  FindMMIOFunc::Result Flagged;
+  DenseMap<const Function *, RuleSetMask> FlaggedBy;
+  for (const FindRuleSets::Finding &Fn : Res.Findings) {
+    if (!Fn.getFlagged())
+      continue;
+    FindMMIOFunc::NonHalMMIOFunc Info(Fn.Site->Ins);
+    Info.CalledByApp = true;
+    Flagged.insert({Fn.Func, Info});
+    FlaggedBy[Fn.Func] = Fn.getFlagged();
+  }
+  std::vector<MMIOFuncGroup> Groups =
+      foldInstantiations(Flagged, /*AppOnly=*/true);
+
+  std::vector<unsigned> Counts(Res.Names.size());
+  for (const MMIOFuncGroup &G : Groups) {
+    RuleSetMask Mask = 0;
+    for (const Function *F : G.Instances)
+      Mask |= FlaggedBy[F];
+    for (unsigned I = 0, E = Res.Names.size(); I != E; ++I)
+      Counts[I] += (Mask >> I) & 1;
+
+    const Function *F = G.Instances[0];
+    OutS << F->getName() << "(" << getDebugLocString(Flagged.at(F).MMIOIns)
+         << "): ";
+    if (Mask == Res.getAll() && Res.Names.size() > 1) {
+      OutS << "all";
+    } else {
+      bool First = true;
+      for (unsigned I = 0, E = Res.Names.size(); I != E; ++I) {
+        if (!((Mask >> I) & 1))
+          continue;
+        OutS << (First ? "" : ", ") << Res.Names[I];
+        First = false;
+      }
+    }
+    if (G.Instances.size() > 1)
+      OutS << " [" << G.Instances.size() << " instantiations]";
+    OutS << "\n";
+  }
+
+  OutS << "Findings: ";
+  for (unsigned I = 0, E = Res.Names.size(); I != E; ++I)
+    OutS << (I ? ", " : "") << Res.Names[I] << " " << Counts[I];
+  OutS << "\n";
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
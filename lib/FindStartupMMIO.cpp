@@ -0,0 +1,170 @@
+//==============================================================================
+// FILE:
+//    FindStartupMMIO.cpp
+//
+// DESCRIPTION:
+//    Reports the hardware accesses made by static initializers, i.e. by the
+//    functions reachable from the constructors in @llvm.global_ctors. These
+//    run before main() and delay everything else, so MMIO accesses, polling
+//    loops and busy waits found here are candidates for lazy or deferred
+//    initialization.
+//
+//    For every initializer, the functions it (transitively) calls that access
+//    MMIO, poll or delay are listed with the call path that reaches them and
+//    an estimated cost (see CostModel.h). HAL bypasses, i.e. non-HAL
+//    functions accessing MMIO directly, are flagged.
+//
+// USAGE:
+//      opt -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindStartupMMIO.so `\`
+//        -passes="print<startup-mmio>" `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindStartupMMIO.h"
+#include "CallPaths.h"
+
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/Format.h"
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "startup-mmio"
+
+// Pretty-prints the result of this analysis
+static void printStartupMMIOResult(llvm::raw_ostream &OutS,
+                                   const FindStartupMMIO::Result &);
+
+//------------------------------------------------------------------------------
+// FindStartupMMIO Implementation
+//------------------------------------------------------------------------------
+FindStartupMMIO::Result
+FindStartupMMIO::runOnModule(Module &M, const FindMMIOSites::Result &Sites,
+                             const FindMMIOFunc::Result &MMIOFuncs,
+                             const CallGraph &CG) {
+  Result Res;
+  CostModel Costs(Sites);
+
+  for (const Function *Ctor : getGlobalCtors(M)) {
+    LLVM_DEBUG(dbgs() << "Static initializer: " << Ctor->getName()
+                      << "\n");
+    Initializer Init;
+    Init.Ctor = Ctor;
+    CallPaths Paths(CG, Ctor);
+    for (const Function *F : Paths.functions()) {
+      const FunctionCost &Cost = Costs.getCost(*F);
+      ArrayRef<MMIOSite> FuncSites = Sites.getSites(F);
+      if (FuncSites.empty() && Cost.Polls.empty() && Cost.Delays.empty())
+        continue;
+      Init.Funcs.push_back({F, Paths.getPath(F), FuncSites,
+                            MMIOFuncs.count(F) != 0, Cost});
+      Init.EstimatedUs += Cost.getEstimatedUs();
+    }
+    // Most expensive first
+    std::stable_sort(Init.Funcs.begin(), Init.Funcs.end(),
+                     [](const StartupFunc &A, const StartupFunc &B) {
+                       return A.Cost.getEstimatedUs() >
+                              B.Cost.getEstimatedUs();
+                     });
+    Res.push_back(std::move(Init));
+  }
+  return Res;
+}
+
+PreservedAnalyses FindStartupMMIOPrinter::run(Module &M,
+                                              ModuleAnalysisManager &MAM) {
+
+  auto &Res = MAM.getResult<FindStartupMMIO>(M);
+
+  printStartupMMIOResult(OS, Res);
+  return PreservedAnalyses::all();
+}
+
+FindStartupMMIO::Result
+FindStartupMMIO::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &Funcs = MAM.getResult<FindMMIOFunc>(M);
+  auto &CG = MAM.getResult<CallGraphAnalysis>(M);
+  return runOnModule(M, Sites, Funcs, CG);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindStartupMMIO::Key;
+
+llvm::PassPluginLibraryInfo getFindStartupMMIOPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "startup-mmio", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<startup-mmio>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<startup-mmio>") {
+                    MPM.addPass(FindStartupMMIOPrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindStartupMMIO>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindStartupMMIO(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindStartupMMIOPluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printStartupMMIOResult(raw_ostream &OutS,
+                                   const FindStartupMMIO::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: MMIO in static initializers\n";
+  OutS << "=================================================\n";
+  double TotalUs = 0;
+  for (const auto &Init : Res) {
+    if (Init.Funcs.empty())
+      continue;
+    TotalUs += Init.EstimatedUs;
+    OutS << Init.Ctor->getName() << format(" (~%.1f us)\n", Init.EstimatedUs);
+    for (const auto &F : Init.Funcs) {
+      OutS << "  " << F.Func->getName()
+           << format(": %u MMIO, %zu polls, %zu delays, ~%.1f us",
+                     (unsigned)F.Sites.size(), F.Cost.Polls.size(),
+                     F.Cost.Delays.size(), F.Cost.getEstimatedUs());
+      if (F.HALBypass)
+        OutS << " [HAL bypass]";
+      OutS << "\n";
+      if (F.Path.size() > 1) {
+        OutS << "    via ";
+        for (size_t I = 0; I < F.Path.size(); ++I)
+          OutS << (I ? " -> " : "") << F.Path[I]->getName();
+        OutS << "\n";
+      }
+      for (const Instruction *Poll : F.Cost.Polls)
+        OutS << "    poll at " << getDebugLocString(Poll) << "\n";
+      for (const auto &D : F.Cost.Delays)
+        OutS << "    " << D.first->getCalledFunction()->getName()
+             << format(" (%.0f us) at ", D.second)
+             << getDebugLocString(D.first) << "\n";
+    }
+  }
+  OutS << format("Total: ~%.1f us before main\n", TotalUs);
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
@@ -0,0 +1,299 @@
+//==============================================================================
+// FILE:
+//    FindTraceCoverage.cpp
+//
+// DESCRIPTION:
+//    Confirms the static MMIO findings with a trace of the peripheral
+//    accesses made by the firmware in an emulator (Renode, QEMU, ...), see
+//    TraceReader.cpp for the formats. Every access of the trace is joined
+//    against the static MMIO sites:
+//      * by address, and by direction if the trace has it,
+//      * by source line if the trace is symbolized, to pick among the sites
+//        accessing the same register, and
+//      * for arrays accessed through a variable index (NRF_GPIO->PIN_CNF[i]),
+//        by the closest array start below the address, in the same 4 KiB
+//        peripheral block.
+//    The findings of FindMMIOFunc are reported as observed (with counts) or
+//    not, and accesses no static site predicts are reported as analysis
+//    gaps.
+//
+//    The trace is streamed, and the state is the per-site counters plus at
+//    most -trace-max-gaps gap entries, so multi-GB traces run in constant
+//    memory.
+//
+// USAGE:
+//      opt -load libFindMMIOFunc.so -load libFindTraceCoverage.so `\`
+//        -load-pass-plugin libFindMMIOFunc.so `\`
+//        -load-pass-plugin libFindTraceCoverage.so `\`
+//        -passes="print<trace-coverage>" -mmio-trace=<trace.log> `\`
+//        -disable-output <input-llvm-file>
+//
+// License: MIT
+//==============================================================================
+#include "FindTraceCoverage.h"
+
+#include "llvm/IR/DebugInfoMetadata.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+    TraceFile("mmio-trace",
+              cl::desc("Peripheral access trace of an emulator run "
+                       "('-' for stdin)"),
+              cl::value_desc("file"));
+
+static cl::opt<unsigned>
+    MaxGaps("trace-max-gaps",
+            cl::desc("Distinct unpredicted addresses to keep track of"),
+            cl::init(1000));
+
+bool hasMMIOTrace() { return !TraceFile.empty(); }
+
+// Pretty-prints the result of this analysis
+static void printTraceCoverageResult(llvm::raw_ostream &OutS,
+                                     const FindMMIOSites::Result &Sites,
+                                     const FindMMIOFunc::Result &MMIOFuncs,
+                                     const FindTraceCoverage::Result &);
+
+//------------------------------------------------------------------------------
+// FindTraceCoverage Implementation
+//------------------------------------------------------------------------------
+static constexpr uint64_t BlockMask = ~uint64_t(0xFFF);
+
+// True if S is at the (symbolized) source line of A
+static bool isAtLine(const MMIOSite &S, const TraceAccess &A) {
+  const DebugLoc &Loc = S.Ins->getDebugLoc();
+  if (!Loc || Loc.getLine() != A.Line)
+    return false;
+  StringRef File = cast<DIScope>(Loc.getScope())->getFilename();
+  return A.File.empty() ||
+         sys::path::filename(File) == sys::path::filename(A.File);
+}
+
+void FindTraceCoverage::match(const TraceAccess &A,
+                              SmallVectorImpl<unsigned> &Matches) {
+  Matches.clear();
+  auto Filter = [&](ArrayRef<unsigned> Candidates, bool ByLine) {
+    for (unsigned I : Candidates) {
+      const MMIOSite &S = Sites->Sites[I];
+      if (A.Kind != TraceAccess::Unknown &&
+          S.IsStore != (A.Kind == TraceAccess::Write))
+        continue;
+      if (ByLine && !isAtLine(S, A))
+        continue;
+      Matches.push_back(I);
+    }
+  };
+  // The line picks among the sites of an address; a stale symbolization
+  // shouldn't turn a predicted access into a gap
+  auto FilterByLine = [&](ArrayRef<unsigned> Candidates) {
+    if (A.Line)
+      Filter(Candidates, /*ByLine=*/true);
+    if (Matches.empty())
+      Filter(Candidates, /*ByLine=*/false);
+  };
+
+  auto It = ByAddr.find(A.Addr);
+  if (It != ByAddr.end())
+    FilterByLine(It->second);
+  if (!Matches.empty())
+    return;
+
+  // An element of an array indexed with a variable
+  auto Indexed = IndexedByBase.find(A.Addr & BlockMask);
+  if (Indexed == IndexedByBase.end())
+    return;
+  uint64_t Start = 0;
+  for (unsigned I : Indexed->second) {
+    uint64_t Addr = Sites->Sites[I].Addr;
+    if (Addr <= A.Addr && Addr > Start)
+      Start = Addr;
+  }
+  SmallVector<unsigned, 4> Candidates;
+  for (unsigned I : Indexed->second)
+    if (Sites->Sites[I].Addr == Start)
+      Candidates.push_back(I);
+  FilterByLine(Candidates);
+}
+
+FindTraceCoverage::Result
+FindTraceCoverage::runOnModule(Module &M, const FindMMIOSites::Result &S) {
+  Result Res;
+  Sites = &S;
+  Res.SiteCounts.assign(S.Sites.size(), 0);
+  if (TraceFile.empty())
+    return Res;
+
+  // 1. Index the static sites
+  for (unsigned I = 0; I < S.Sites.size(); ++I) {
+    // A passed on address is accessed elsewhere, if at all
+    if (S.Sites[I].AddressTaken)
+      continue;
+    ByAddr[S.Sites[I].Addr].push_back(I);
+    if (!S.Sites[I].Exact)
+      IndexedByBase[S.Sites[I].Addr & BlockMask].push_back(I);
+  }
+
+  // 2. Stream the trace
+  DenseMap<uint64_t, unsigned> GapIds;
+  SmallVector<unsigned, 4> Matches;
+  TraceAccess A;
+  Error Err = forEachTraceLine(
+      TraceFile,
+      [&](StringRef Line) {
+        ++Res.Lines;
+        if (!parseTraceLine(Line, A))
+          return;
+        ++Res.Accesses;
+        match(A, Matches);
+        if (!Matches.empty()) {
+          ++Res.Matched;
+          for (unsigned I : Matches)
+            ++Res.SiteCounts[I];
+          return;
+        }
+        auto Id = GapIds.find(A.Addr);
+        if (Id == GapIds.end()) {
+          if (Res.Gaps.size() >= MaxGaps) {
+            ++Res.DroppedGaps;
+            return;
+          }
+          Id = GapIds.try_emplace(A.Addr, Res.Gaps.size()).first;
+          std::string Loc;
+          if (A.Line)
+            Loc = (A.File + ":" + Twine(A.Line)).str();
+          Res.Gaps.push_back({A.Addr, 0, A.Kind == TraceAccess::Write, A.PC,
+                              std::move(Loc)});
+        }
+        ++Res.Gaps[Id->second].Count;
+      },
+      &Res.SkippedLines);
+  if (Err) {
+    logAllUnhandledErrors(std::move(Err), errs(), "-mmio-trace: ");
+    return Res;
+  }
+  Res.Loaded = true;
+
+  std::stable_sort(Res.Gaps.begin(), Res.Gaps.end(),
+                   [](const Gap &A, const Gap &B) { return A.Count > B.Count; });
+  ByAddr.clear();
+  IndexedByBase.clear();
+  return Res;
+}
+
+PreservedAnalyses FindTraceCoveragePrinter::run(Module &M,
+                                                ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  auto &MMIOFuncs = MAM.getResult<FindMMIOFunc>(M);
+  auto &Res = MAM.getResult<FindTraceCoverage>(M);
+
+  printTraceCoverageResult(OS, Sites, MMIOFuncs, Res);
+  return PreservedAnalyses::all();
+}
+
+FindTraceCoverage::Result
+FindTraceCoverage::run(llvm::Module &M, llvm::ModuleAnalysisManager &MAM) {
+  auto &Sites = MAM.getResult<FindMMIOSites>(M);
+  return runOnModule(M, Sites);
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+AnalysisKey FindTraceCoverage::Key;
+
+llvm::PassPluginLibraryInfo getFindTraceCoveragePluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "trace-coverage", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // #1 REGISTRATION FOR "opt -passes=print<trace-coverage>"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "print<trace-coverage>") {
+                    MPM.addPass(FindTraceCoveragePrinter(llvm::errs()));
+                    return true;
+                  }
+                  return false;
+                });
+            // #2 REGISTRATION FOR "MAM.getResult<FindTraceCoverage>(Module)"
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([&] { return FindTraceCoverage(); });
+                });
+          }};
+};
+
+#ifndef LT_HALBYPASS_ALL
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getFindTraceCoveragePluginInfo();
+}
+#endif
+
+//------------------------------------------------------------------------------
+// Helper functions
+//------------------------------------------------------------------------------
+static void printTraceCoverageResult(raw_ostream &OutS,
+                                     const FindMMIOSites::Result &Sites,
+                                     const FindMMIOFunc::Result &MMIOFuncs,
+                                     const FindTraceCoverage::Result &Res) {
+  OutS << "================================================="
+       << "\n";
+  OutS << "LLVM-TUTOR: Emulator trace coverage\n";
+  OutS << "=================================================\n";
+  if (!Res.Loaded) {
+    OutS << "No trace, pass one with -mmio-trace=<file>\n";
+    OutS << "-------------------------------------------------"
+         << "\n\n";
+    return;
+  }
+  OutS << Res.Lines << " lines, " << Res.Accesses << " accesses, "
+       << Res.Matched << " predicted by a static site\n";
+  if (Res.SkippedLines)
+    OutS << Res.SkippedLines << " overlong lines skipped\n";
+
+  // The findings, with the accesses to all their sites
+  OutS << "\nFindings:\n";
+  for (const MMIOFuncGroup &G : foldInstantiations(MMIOFuncs,
+                                                   /*AppOnly=*/true)) {
+    uint64_t Count = 0;
+    unsigned Observed = 0, Total = 0;
+    for (const Function *F : G.Instances)
+      for (const MMIOSite &S : Sites.getSites(F)) {
+        if (S.AddressTaken)
+          continue;
+        uint64_t N = Res.SiteCounts[&S - Sites.Sites.data()];
+        Count += N;
+        Observed += N != 0;
+        ++Total;
+      }
+    OutS << "  " << G.Instances[0]->getName() << ": ";
+    if (Count)
+      OutS << "observed " << Count << " times (" << Observed << "/" << Total
+           << " sites)\n";
+    else
+      OutS << "not observed\n";
+  }
+
+  OutS << "\nAnalysis gaps (accesses no static site predicts):\n";
+  for (const FindTraceCoverage::Gap &G : Res.Gaps) {
+    OutS << "  " << (G.Write ? "write" : "read ") << " 0x"
+         << Twine::utohexstr(G.Addr) << " x" << G.Count;
+    if (G.PC)
+      OutS << ", first at pc 0x" << Twine::utohexstr(*G.PC);
+    if (!G.SourceLoc.empty())
+      OutS << " (" << G.SourceLoc << ")";
+    OutS << "\n";
+  }
+  if (Res.DroppedGaps)
+    OutS << "  ... and " << Res.DroppedGaps
+         << " accesses to more addresses (-trace-max-gaps)\n";
+
+  OutS << "-------------------------------------------------"
+       << "\n\n";
+}
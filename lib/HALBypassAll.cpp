@@ -0,0 +1,113 @@
+//==============================================================================
+// FILE:
+//    HALBypassAll.cpp
+//
+// DESCRIPTION:
+//    The pass plugin entry point of libHALBypassAll, which is built from the
+//    sources of all the other plugins. Loading it on its own replaces
+//    loading libFindMMIOFunc.so, libFindHALBypass.so, ... together, each of
+//    which defines a weak llvmGetPassPluginInfo. It registers every pass
+//    the other plugins register, and "hal-bypass-all", which runs all the
+//    reports. The analyses are cached by the pass manager, so the MMIO scan
+//    (FindMMIOSites), the classification (FindMMIOFunc), the call graph
+//    (CallGraphAnalysis) and the functions reachable from the application
+//    roots (AppReachability) are computed once for all of them.
+//
+// USAGE:
+//      opt -load libHALBypassAll.so -load-pass-plugin libHALBypassAll.so `\`
+//        -passes="hal-bypass-all" -disable-output <input-llvm-file>
+//
+//    Don't load it together with the other plugins: they define the same
+//    command line options.
+//
+// License: MIT
+//==============================================================================
+#include "FindBootPath.h"
+#include "FindCriticalSections.h"
+#include "FindDeadHAL.h"
+#include "FindHALBypass.h"
+#include "FindHALCoverage.h"
+#include "FindIRQStorm.h"
+#include "FindInitSequences.h"
+#include "FindMMIOFunc.h"
+#include "FindPowerPairing.h"
+#include "FindRedundantWrites.h"
+#include "FindRuleSets.h"
+#include "FindStartupMMIO.h"
+#include "FindTraceCoverage.h"
+
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+
+using namespace llvm;
+
+// The entry points of the individual plugins
+llvm::PassPluginLibraryInfo getFindMMIOFuncPluginInfo();
+llvm::PassPluginLibraryInfo getFindHALBypassPluginInfo();
+llvm::PassPluginLibraryInfo getFindStartupMMIOPluginInfo();
+llvm::PassPluginLibraryInfo getFindBootPathPluginInfo();
+llvm::PassPluginLibraryInfo getFindIRQStormPluginInfo();
+llvm::PassPluginLibraryInfo getFindCriticalSectionsPluginInfo();
+llvm::PassPluginLibraryInfo getFindPowerPairingPluginInfo();
+llvm::PassPluginLibraryInfo getFindRedundantWritesPluginInfo();
+llvm::PassPluginLibraryInfo getFindInitSequencesPluginInfo();
+llvm::PassPluginLibraryInfo getFindDeadHALPluginInfo();
+llvm::PassPluginLibraryInfo getFindTraceCoveragePluginInfo();
+
+// The reports of "hal-bypass-all", in order
+static void addAllReports(ModulePassManager &MPM) {
+  MPM.addPass(FindMMIOFuncPrinter(llvm::errs()));
+  if (hasRuleSets())
+    MPM.addPass(FindRuleSetsPrinter(llvm::errs()));
+  MPM.addPass(FindHALBypassPrinter(llvm::errs()));
+  MPM.addPass(FindHALCoveragePrinter(llvm::errs()));
+  MPM.addPass(FindDeadHALPrinter(llvm::errs()));
+  MPM.addPass(FindStartupMMIOPrinter(llvm::errs()));
+  MPM.addPass(FindBootPathPrinter(llvm::errs()));
+  MPM.addPass(FindIRQStormPrinter(llvm::errs()));
+  MPM.addPass(FindCriticalSectionsPrinter(llvm::errs()));
+  MPM.addPass(FindPowerPairingPrinter(llvm::errs()));
+  MPM.addPass(FindRedundantWritesPrinter(llvm::errs()));
+  MPM.addPass(FindInitSequencesPrinter(llvm::errs()));
+  if (hasMMIOTrace())
+    MPM.addPass(FindTraceCoveragePrinter(llvm::errs()));
+}
+
+//------------------------------------------------------------------------------
+// New PM Registration
+//------------------------------------------------------------------------------
+llvm::PassPluginLibraryInfo getHALBypassAllPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "hal-bypass-all", LLVM_VERSION_STRING,
+          [](PassBuilder &PB) {
+            // The passes and analyses of the individual plugins
+            for (auto GetInfo :
+                 {getFindMMIOFuncPluginInfo, getFindHALBypassPluginInfo,
+                  getFindStartupMMIOPluginInfo, getFindBootPathPluginInfo,
+                  getFindIRQStormPluginInfo,
+                  getFindCriticalSectionsPluginInfo,
+                  getFindPowerPairingPluginInfo,
+                  getFindRedundantWritesPluginInfo,
+                  getFindInitSequencesPluginInfo, getFindDeadHALPluginInfo,
+                  getFindTraceCoveragePluginInfo})
+              GetInfo().RegisterPassBuilderCallbacks(PB);
+
+            // REGISTRATION FOR "opt -passes=hal-bypass-all"
+            PB.registerPipelineParsingCallback(
+                [&](StringRef Name, ModulePassManager &MPM,
+                    ArrayRef<PassBuilder::PipelineElement>) {
+                  if (Name == "hal-bypass-all") {
+                    addAllReports(MPM);
+                    return true;
+                  }
+                  return false;
+                });
+          }};
+}
+
+// The plugin sources are built with LT_HALBYPASS_ALL, which leaves out
+// their own definitions of llvmGetPassPluginInfo, so that this one is the
+// only one in the library (weak definitions would be picked by link order)
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return getHALBypassAllPluginInfo();
+}
@@ -0,0 +1,185 @@
+//==============================================================================
+// FILE:
+//    HALBypassC.cpp
+//
+// DESCRIPTION:
+//    Implements the C interface of the HALBypass library (HALBypass.h). The
+//    analyses are run directly through their runOnModule() entry points, so
+//    that no pass manager or PassBuilder is needed, and their results are
+//    kept alive for the cursors to read.
+//
+// License: MIT
+//==============================================================================
+#include "HALBypass.h"
+
+#include "FindMMIOFunc.h"
+#include "FindMMIOSites.h"
+
+#include "llvm-c/Core.h"
+#include "llvm/ADT/Optional.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+
+using namespace llvm;
+
+// The members are destroyed bottom-up: the results before the module they
+// refer to
+struct HBOpaqueAnalysis {
+  // Set for HBAnalyzeFile only
+  std::unique_ptr<LLVMContext> OwnedContext;
+  std::unique_ptr<Module> OwnedModule;
+
+  Module *M = nullptr;
+  FindMMIOSites::Result Sites;
+  FindMMIOFunc::Result Funcs;
+};
+
+struct HBOpaqueCursor {
+  enum KindTy { Sites, Funcs };
+
+  const HBOpaqueAnalysis *A;
+  KindTy Kind;
+  // Sites: index of the current site
+  size_t Index;
+  // Funcs: the current function
+  FindMMIOFunc::Result::const_iterator Func;
+  bool Started = false;
+
+  const MMIOSite &getSite() const { return A->Sites.Sites[Index]; }
+  const Instruction *getInstruction() const {
+    return Kind == Sites ? getSite().Ins : Func->second.MMIOIns;
+  }
+};
+
+static HBOpaqueAnalysis *analyze(std::unique_ptr<HBOpaqueAnalysis> A) {
+  FindMMIOSites SitesPass;
+  A->Sites = SitesPass.runOnModule(*A->M);
+  // Built on first use, like the pass manager's cached analyses
+  Optional<CallGraph> CG;
+  Optional<AppReachability::Result> Reachable;
+  auto GetCG = [&]() -> const CallGraph & {
+    if (!CG)
+      CG.emplace(*A->M);
+    return *CG;
+  };
+  auto GetReachable = [&]() -> const AppReachability::Result & {
+    if (!Reachable)
+      Reachable.emplace(AppReachability::runOnModule(*A->M, GetCG()));
+    return *Reachable;
+  };
+  FindMMIOFunc FuncPass;
+  A->Funcs = FuncPass.runOnModule(*A->M, A->Sites, GetCG, GetReachable);
+  return A.release();
+}
+
+//------------------------------------------------------------------------------
+// Analyses
+//------------------------------------------------------------------------------
+int HBSetOptions(int Argc, const char *const *Argv) {
+  return cl::ParseCommandLineOptions(Argc, Argv, "", &errs());
+}
+
+HBAnalysisRef HBAnalyzeFile(const char *Path, char **ErrorMessage) {
+  auto A = std::make_unique<HBOpaqueAnalysis>();
+  A->OwnedContext = std::make_unique<LLVMContext>();
+  SMDiagnostic Err;
+  A->OwnedModule = parseIRFile(Path, Err, *A->OwnedContext);
+  if (!A->OwnedModule) {
+    std::string Msg;
+    raw_string_ostream OS(Msg);
+    Err.print(/*ProgName=*/nullptr, OS, /*ShowColors=*/false);
+    if (ErrorMessage)
+      *ErrorMessage = LLVMCreateMessage(OS.str().c_str());
+    return nullptr;
+  }
+  A->M = A->OwnedModule.get();
+  return analyze(std::move(A));
+}
+
+HBAnalysisRef HBAnalyzeModule(LLVMModuleRef M) {
+  auto A = std::make_unique<HBOpaqueAnalysis>();
+  A->M = unwrap(M);
+  return analyze(std::move(A));
+}
+
+void HBDisposeAnalysis(HBAnalysisRef A) { delete A; }
+
+LLVMModuleRef HBGetModule(HBAnalysisRef A) { return wrap(A->M); }
+
+//------------------------------------------------------------------------------
+// Cursors
+//------------------------------------------------------------------------------
+HBCursorRef HBGetMMIOSites(HBAnalysisRef A) {
+  return new HBOpaqueCursor{A, HBOpaqueCursor::Sites, 0, A->Funcs.end()};
+}
+
+HBCursorRef HBGetMMIOFuncs(HBAnalysisRef A) {
+  return new HBOpaqueCursor{A, HBOpaqueCursor::Funcs, 0, A->Funcs.begin()};
+}
+
+int HBCursorNext(HBCursorRef C) {
+  bool First = !C->Started;
+  C->Started = true;
+  if (C->Kind == HBOpaqueCursor::Sites) {
+    size_t N = C->A->Sites.Sites.size();
+    if (!First && C->Index < N)
+      ++C->Index;
+    return C->Index < N;
+  }
+  if (!First && C->Func != C->A->Funcs.end())
+    ++C->Func;
+  return C->Func != C->A->Funcs.end();
+}
+
+void HBDisposeCursor(HBCursorRef C) { delete C; }
+
+LLVMValueRef HBCursorGetFunction(HBCursorRef C) {
+  return wrap(C->getInstruction()->getFunction());
+}
+
+LLVMValueRef HBCursorGetInstruction(HBCursorRef C) {
+  return wrap(C->getInstruction());
+}
+
+uint64_t HBCursorGetAddress(HBCursorRef C) {
+  return C->Kind == HBOpaqueCursor::Sites ? C->getSite().Addr
+                                          : C->Func->second.Addr;
+}
+
+int HBCursorIsStore(HBCursorRef C) {
+  return isa<StoreInst>(C->getInstruction());
+}
+
+const char *HBCursorGetPeripheral(HBCursorRef C, size_t *Len,
+                                  uint64_t *Base) {
+  StringRef Name;
+  uint64_t Begin = 0;
+  if (C->Kind == HBOpaqueCursor::Sites) {
+    if (const Region *P = C->A->Sites.getPeripheral(C->getSite())) {
+      Name = P->Name;
+      Begin = P->Begin;
+    }
+  } else if (!C->Func->second.Peripheral.empty()) {
+    Name = C->Func->second.Peripheral;
+    Begin = C->Func->second.PeripheralBase;
+  }
+  if (Name.empty())
+    return nullptr;
+  if (Len)
+    *Len = Name.size();
+  if (Base)
+    *Base = Begin;
+  return Name.data();
+}
+
+int HBCursorIsCalledByApp(HBCursorRef C) {
+  return C->Kind == HBOpaqueCursor::Funcs && C->Func->second.CalledByApp;
+}
+
+LLVMValueRef HBCursorGetCaller(HBCursorRef C) {
+  if (C->Kind != HBOpaqueCursor::Funcs || !C->Func->second.Caller)
+    return nullptr;
+  return wrap(C->Func->second.Caller);
+}
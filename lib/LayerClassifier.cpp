@@ -0,0 +1,491 @@
+//==============================================================================
+// FILE:
+//    LayerClassifier.cpp
+//
+// DESCRIPTION:
+//    Rule-based classification of functions into architectural layers (app,
+//    HAL, third-party). The rules are configured on the command line, e.g.:
+//
+//      -namespace-layer=Pinetime::Drivers=hal
+//      -namespace-layer=Pinetime::Applications=app,Pinetime::Controllers=app
+//
+//    Source directories are assigned with path rules. Relative rules are
+//    resolved against -source-root (the current directory by default):
+//
+//      -source-root=/path/to/InfiniTime
+//      -path-layer=src/drivers=hal,src/libs/lvgl=third-party,src=app
+//
+//    Layers can also be declared per build target, with the source file ->
+//    target mapping taken from the build system:
+//
+//      -compile-commands=build/compile_commands.json  (or)
+//      -cmake-file-api=build/.cmake/api/v1/reply
+//      -target-layer=nrf-sdk=hal,lvgl=third-party,infinitime=app
+//
+//    Bitcode built without debug info can be classified by symbol name,
+//    section and by the object file a symbol was linked from:
+//
+//      -symbol-layer=nrf_=hal,nrfx_=hal,lv_=third-party
+//      -section-layer=.text.hal=hal
+//      -linker-map=build/src/pinetime-app.map  (with -target-layer rules)
+//
+//    Path rules are matched against the source file of a function's
+//    DISubprogram, component by component; each file is classified once.
+//    Namespace rules are matched against the demangled declaration context of
+//    a function's linkage name. Each linkage name is demangled only once (the
+//    result is memoized). For both, the most specific (longest) prefix wins.
+//
+//    Note that opt parses its command line before loading pass plugins. In
+//    order to use the options below, load the plugin with `-load` as well as
+//    `-load-pass-plugin`.
+//
+// License: MIT
+//==============================================================================
+#include "LayerClassifier.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+
+using namespace llvm;
+
+static cl::list<std::string>
+    NamespaceLayers("namespace-layer",
+                    cl::desc("Assign a layer to a C++ namespace prefix "
+                             "(<namespace>=<app|hal|third-party>)"),
+                    cl::CommaSeparated, cl::ZeroOrMore);
+
+static cl::list<std::string>
+    PathLayers("path-layer",
+               cl::desc("Assign a layer to a source directory "
+                        "(<dir>=<app|hal|third-party>)"),
+               cl::CommaSeparated, cl::ZeroOrMore);
+
+static cl::opt<std::string>
+    SourceRoot("source-root",
+               cl::desc("Directory that relative -path-layer rules are "
+                        "relative to (default: current directory)"),
+               cl::value_desc("dir"));
+
+static cl::opt<std::string>
+    CompileCommands("compile-commands",
+                    cl::desc("compile_commands.json used to map source files "
+                             "to build targets"),
+                    cl::value_desc("file"));
+
+static cl::opt<std::string>
+    CMakeFileAPI("cmake-file-api",
+                 cl::desc("CMake file-API reply directory used to map source "
+                          "files to build targets"),
+                 cl::value_desc("dir"));
+
+static cl::list<std::string>
+    TargetLayers("target-layer",
+                 cl::desc("Assign a layer to a build target "
+                          "(<target>=<app|hal|third-party>)"),
+                 cl::CommaSeparated, cl::ZeroOrMore);
+
+static cl::list<std::string>
+    SymbolLayers("symbol-layer",
+                 cl::desc("Assign a layer to a linkage name prefix "
+                          "(<prefix>=<app|hal|third-party>)"),
+                 cl::CommaSeparated, cl::ZeroOrMore);
+
+static cl::list<std::string>
+    SectionLayers("section-layer",
+                  cl::desc("Assign a layer to a section name prefix "
+                           "(<prefix>=<app|hal|third-party>)"),
+                  cl::CommaSeparated, cl::ZeroOrMore);
+
+static cl::opt<std::string>
+    LinkerMapFile("linker-map",
+                  cl::desc("GNU ld map file used to map symbols to the build "
+                           "targets they were linked from"),
+                  cl::value_desc("file"));
+
+//------------------------------------------------------------------------------
+// Layers
+//------------------------------------------------------------------------------
+Layer parseLayer(StringRef Name) {
+  return StringSwitch<Layer>(Name.trim().lower())
+      .Case("app", Layer::App)
+      .Cases("hal", "driver", Layer::HAL)
+      .Cases("third-party", "lib", Layer::ThirdParty)
+      .Default(Layer::Unknown);
+}
+
+StringRef getLayerName(Layer L) {
+  switch (L) {
+  case Layer::App:
+    return "app";
+  case Layer::HAL:
+    return "hal";
+  case Layer::ThirdParty:
+    return "third-party";
+  case Layer::Unknown:
+    break;
+  }
+  return "unknown";
+}
+
+bool parseLayerRule(StringRef Rule, StringRef &Key, Layer &L) {
+  // Split at the last '=' so that keys may contain '='
+  size_t Pos = Rule.rfind('=');
+  if (Pos == StringRef::npos)
+    return false;
+  Key = Rule.take_front(Pos).trim();
+  L = parseLayer(Rule.drop_front(Pos + 1));
+  return !Key.empty() && L != Layer::Unknown;
+}
+
+//------------------------------------------------------------------------------
+// ComponentTrie
+//------------------------------------------------------------------------------
+void ComponentTrie::insert(ArrayRef<StringRef> Components, Layer L) {
+  unsigned Cur = 0;
+  for (StringRef C : Components) {
+    auto It = Nodes[Cur].Children.find(C);
+    if (It != Nodes[Cur].Children.end()) {
+      Cur = It->second;
+      continue;
+    }
+    unsigned Next = Nodes.size();
+    Nodes[Cur].Children[C] = Next;
+    // Careful, this may invalidate references into Nodes
+    Nodes.emplace_back();
+    Cur = Next;
+  }
+  Nodes[Cur].L = L;
+  Nodes[Cur].HasLayer = true;
+}
+
+Layer ComponentTrie::lookup(ArrayRef<StringRef> Components) const {
+  unsigned Cur = 0;
+  Layer Res = Nodes[0].HasLayer ? Nodes[0].L : Layer::Unknown;
+  for (StringRef C : Components) {
+    auto It = Nodes[Cur].Children.find(C);
+    if (It == Nodes[Cur].Children.end())
+      break;
+    Cur = It->second;
+    if (Nodes[Cur].HasLayer)
+      Res = Nodes[Cur].L;
+  }
+  return Res;
+}
+
+//------------------------------------------------------------------------------
+// NamespaceClassifier
+//------------------------------------------------------------------------------
+void splitQualifiedName(StringRef Name, SmallVectorImpl<StringRef> &Components) {
+  unsigned Depth = 0;
+  size_t Start = 0;
+  for (size_t I = 0; I < Name.size(); ++I) {
+    char C = Name[I];
+    if (C == '<' || C == '(')
+      ++Depth;
+    else if ((C == '>' || C == ')') && Depth > 0)
+      --Depth;
+    else if (Depth == 0 && C == ':' && I + 1 < Name.size() &&
+             Name[I + 1] == ':') {
+      if (I > Start)
+        Components.push_back(Name.slice(Start, I));
+      Start = I + 2;
+      ++I;
+    }
+  }
+  if (Start < Name.size())
+    Components.push_back(Name.drop_front(Start));
+}
+
+NamespaceClassifier::NamespaceClassifier(NamespaceClassifier &&Other)
+    : Demangler(std::move(Other.Demangler)), Buf(Other.Buf),
+      BufSize(Other.BufSize), Cache(std::move(Other.Cache)),
+      Trie(std::move(Other.Trie)) {
+  Other.Buf = nullptr;
+  Other.BufSize = 0;
+}
+
+NamespaceClassifier::~NamespaceClassifier() { std::free(Buf); }
+
+void NamespaceClassifier::addRule(StringRef Prefix, Layer L) {
+  SmallVector<StringRef, 4> Components;
+  splitQualifiedName(Prefix, Components);
+  Trie.insert(Components, L);
+  // Cached layers were computed against the old rule set
+  Cache.clear();
+}
+
+const NamespaceClassifier::Entry &
+NamespaceClassifier::lookup(StringRef LinkageName) {
+  auto Ins = Cache.try_emplace(LinkageName, Entry{std::string(), Layer::Unknown});
+  Entry &E = Ins.first->second;
+  if (!Ins.second)
+    return E;
+
+  // The demangler wants a NUL-terminated string. The key stored in the cache
+  // is one.
+  StringRef Key = Ins.first->first();
+  if (!Demangler.partialDemangle(Key.data()) && Demangler.isFunction()) {
+    size_t N = BufSize;
+    char *Res = Demangler.getFunctionDeclContextName(Buf, &N);
+    if (Res) {
+      Buf = Res;
+      BufSize = std::max(BufSize, N);
+      E.Path = Res;
+    }
+  }
+
+  SmallVector<StringRef, 4> Components;
+  splitQualifiedName(E.Path, Components);
+  E.L = Trie.lookup(Components);
+  return E;
+}
+
+StringRef NamespaceClassifier::getNamespacePath(StringRef LinkageName) {
+  return lookup(LinkageName).Path;
+}
+
+Layer NamespaceClassifier::classify(StringRef LinkageName) {
+  if (Trie.empty())
+    return Layer::Unknown;
+  return lookup(LinkageName).L;
+}
+
+//------------------------------------------------------------------------------
+// PathClassifier
+//------------------------------------------------------------------------------
+static void splitPath(StringRef Path, SmallVectorImpl<StringRef> &Components) {
+  for (auto It = sys::path::begin(Path), E = sys::path::end(Path); It != E;
+       ++It)
+    // Trailing separators show up as "."
+    if (*It != ".")
+      Components.push_back(*It);
+}
+
+void PathClassifier::addRule(StringRef Root, StringRef Prefix, Layer L) {
+  std::string Path = normalizePath(Root, Prefix);
+  SmallVector<StringRef, 8> Components;
+  splitPath(Path, Components);
+  Trie.insert(Components, L);
+}
+
+Layer PathClassifier::classify(StringRef Path) const {
+  SmallVector<StringRef, 8> Components;
+  splitPath(Path, Components);
+  return Trie.lookup(Components);
+}
+
+//------------------------------------------------------------------------------
+// PrefixRules
+//------------------------------------------------------------------------------
+void PrefixRules::addRule(StringRef Prefix, Layer L) {
+  auto It = std::find_if(Rules.begin(), Rules.end(),
+                         [Prefix](const std::pair<std::string, Layer> &R) {
+                           return R.first.size() < Prefix.size();
+                         });
+  Rules.insert(It, {Prefix.str(), L});
+}
+
+Layer PrefixRules::classify(StringRef Name) const {
+  for (const auto &R : Rules)
+    if (Name.startswith(R.first))
+      return R.second;
+  return Layer::Unknown;
+}
+
+//------------------------------------------------------------------------------
+// LayerRules
+//------------------------------------------------------------------------------
+LayerRules LayerRules::fromCommandLine() {
+  // The options are globals of the same names as the members
+  LayerRules Rules;
+  Rules.NamespaceLayers.assign(::NamespaceLayers.begin(),
+                               ::NamespaceLayers.end());
+  Rules.PathLayers.assign(::PathLayers.begin(), ::PathLayers.end());
+  Rules.TargetLayers.assign(::TargetLayers.begin(), ::TargetLayers.end());
+  Rules.SymbolLayers.assign(::SymbolLayers.begin(), ::SymbolLayers.end());
+  Rules.SectionLayers.assign(::SectionLayers.begin(), ::SectionLayers.end());
+  Rules.SourceRoot = ::SourceRoot;
+  Rules.CompileCommands = ::CompileCommands;
+  Rules.CMakeFileAPI = ::CMakeFileAPI;
+  Rules.LinkerMapFile = ::LinkerMapFile;
+  return Rules;
+}
+
+Expected<LayerRules> LayerRules::load(StringRef Path) {
+  auto Buf = MemoryBuffer::getFile(Path);
+  if (!Buf)
+    return createStringError(Buf.getError(), "cannot read '%s'",
+                             Path.str().c_str());
+
+  LayerRules Rules;
+  SmallVector<StringRef, 32> Lines;
+  (*Buf)->getBuffer().split(Lines, '\n');
+  for (unsigned I = 0; I < Lines.size(); ++I) {
+    StringRef Line = Lines[I].trim();
+    if (Line.empty() || Line.startswith("#"))
+      continue;
+    // "-path-layer=..." is accepted too, as on the command line
+    Line.consume_front("-");
+    StringRef Name, Value;
+    std::tie(Name, Value) = Line.split('=');
+    Value = Value.trim();
+
+    std::vector<std::string> *List =
+        StringSwitch<std::vector<std::string> *>(Name.trim())
+            .Case("namespace-layer", &Rules.NamespaceLayers)
+            .Case("path-layer", &Rules.PathLayers)
+            .Case("target-layer", &Rules.TargetLayers)
+            .Case("symbol-layer", &Rules.SymbolLayers)
+            .Case("section-layer", &Rules.SectionLayers)
+            .Default(nullptr);
+    std::string *Single =
+        StringSwitch<std::string *>(Name.trim())
+            .Case("source-root", &Rules.SourceRoot)
+            .Case("compile-commands", &Rules.CompileCommands)
+            .Case("cmake-file-api", &Rules.CMakeFileAPI)
+            .Case("linker-map", &Rules.LinkerMapFile)
+            .Default(nullptr);
+    if (List) {
+      // Comma separated, like the command line options
+      SmallVector<StringRef, 4> Values;
+      Value.split(Values, ',', -1, /*KeepEmpty=*/false);
+      for (StringRef V : Values)
+        List->push_back(V.trim().str());
+    } else if (Single) {
+      *Single = Value.str();
+    } else {
+      return createStringError(inconvertibleErrorCode(),
+                               "%s:%u: unknown option '%s'",
+                               Path.str().c_str(), I + 1,
+                               Name.str().c_str());
+    }
+  }
+  return Rules;
+}
+
+//------------------------------------------------------------------------------
+// LayerClassifier
+//------------------------------------------------------------------------------
+// Parses every "<key>=<layer>" rule of the option OptName and hands it to
+// AddRule
+template <typename CallbackTy>
+static void parseLayerRules(StringRef OptName,
+                            const std::vector<std::string> &Opt,
+                            CallbackTy AddRule) {
+  for (const std::string &Rule : Opt) {
+    StringRef Key;
+    Layer L;
+    if (!parseLayerRule(Rule, Key, L)) {
+      errs() << "Ignoring malformed -" << OptName << " rule: " << Rule
+             << "\n";
+      continue;
+    }
+    AddRule(Key, L);
+  }
+}
+
+void LayerClassifier::configure() {
+  if (!Configured)
+    configure(LayerRules::fromCommandLine());
+}
+
+void LayerClassifier::configure(const LayerRules &Rules) {
+  if (Configured)
+    return;
+  Configured = true;
+
+  parseLayerRules("namespace-layer", Rules.NamespaceLayers,
+                  [this](StringRef Key, Layer L) { Namespaces.addRule(Key, L); });
+
+  SmallString<256> Root(Rules.SourceRoot);
+  if (Root.empty())
+    sys::fs::current_path(Root);
+  parseLayerRules("path-layer", Rules.PathLayers,
+                  [this, &Root](StringRef Key, Layer L) {
+                    Paths.addRule(Root, Key, L);
+                  });
+
+  parseLayerRules("section-layer", Rules.SectionLayers,
+                  [this](StringRef Key, Layer L) { Sections.addRule(Key, L); });
+  parseLayerRules("symbol-layer", Rules.SymbolLayers,
+                  [this](StringRef Key, Layer L) { Symbols.addRule(Key, L); });
+
+  if (!Rules.CompileCommands.empty())
+    if (Error E = Components.loadCompileCommands(Rules.CompileCommands))
+      logAllUnhandledErrors(std::move(E), errs(), "-compile-commands: ");
+  if (!Rules.CMakeFileAPI.empty())
+    if (Error E = Components.loadFileAPIReply(Rules.CMakeFileAPI))
+      logAllUnhandledErrors(std::move(E), errs(), "-cmake-file-api: ");
+
+  if (!Rules.LinkerMapFile.empty())
+    if (Error E = Map.load(Rules.LinkerMapFile))
+      logAllUnhandledErrors(std::move(E), errs(), "-linker-map: ");
+
+  StringMap<Layer> Targets;
+  parseLayerRules("target-layer", Rules.TargetLayers,
+                  [&Targets](StringRef Key, Layer L) { Targets[Key] = L; });
+  ComponentLayers.assign(Components.size(), Layer::Unknown);
+  for (unsigned I = 0, E = Components.size(); I != E; ++I)
+    ComponentLayers[I] = Targets.lookup(Components.getName(I));
+  OriginLayers.assign(Map.getNumOrigins(), Layer::Unknown);
+  for (unsigned I = 0, E = Map.getNumOrigins(); I != E; ++I)
+    OriginLayers[I] = Targets.lookup(
+        ComponentMap::getTargetFromObjectPath(Map.getOrigin(I)));
+}
+
+Layer LayerClassifier::classifyFile(const DIFile *File) {
+  if (!File || (Paths.empty() && Components.empty()))
+    return Layer::Unknown;
+
+  auto Ins = FileLayers.try_emplace(File, Layer::Unknown);
+  if (!Ins.second)
+    return Ins.first->second;
+
+  std::string Path = normalizePath(File->getDirectory(), File->getFilename());
+  Layer L = Paths.classify(Path);
+  if (L == Layer::Unknown) {
+    unsigned Component = Components.lookup(Path);
+    if (Component != ComponentMap::None)
+      L = ComponentLayers[Component];
+  }
+  Ins.first->second = L;
+  return L;
+}
+
+Layer LayerClassifier::classify(const Function &F) {
+  if (const DISubprogram *DISub = F.getSubprogram()) {
+    Layer L = classifyFile(DISub->getFile());
+    if (L != Layer::Unknown)
+      return L;
+  }
+
+  return classifySymbol(F);
+}
+
+Layer LayerClassifier::classifySymbol(const Function &F) {
+  // The IR name of a function is its linkage name, so none of this needs
+  // debug info.
+  if (!F.hasName())
+    return Layer::Unknown;
+  StringRef Name = F.getName();
+
+  Layer L = Namespaces.classify(Name);
+  if (L == Layer::Unknown && F.hasSection())
+    L = Sections.classify(F.getSection());
+  if (L == Layer::Unknown)
+    L = Symbols.classify(Name);
+  if (L == Layer::Unknown && !Map.empty()) {
+    unsigned Origin = Map.lookup(Name);
+    if (Origin != LinkerMap::None)
+      L = OriginLayers[Origin];
+  }
+  return L;
+}
@@ -0,0 +1,121 @@
+//==============================================================================
+// FILE:
+//    LinkerMap.cpp
+//
+// DESCRIPTION:
+//    Reads the symbol -> input file mapping from a GNU ld map file. With
+//    -ffunction-sections every function lives in its own input section,
+//    ".text.<linkage name>", which the map lists together with the object
+//    file or archive member it came from:
+//
+//       .text._ZN8Pinetime7Drivers3Spi5WriteEv
+//                      0x0000000000000224       0x40 CMakeFiles/...Spi.cpp.o
+//                      0x0000000000000224                Pinetime::Drivers...
+//       .text.nrf_gpio_cfg
+//                      0x0000000000000200       0x24 libnrf-sdk.a(nrf_gpio.c.o)
+//
+//    Section names are used as the primary source. Symbol lines following an
+//    input section are recorded too (they cover code built without
+//    -ffunction-sections, but may be demangled).
+//
+// License: MIT
+//==============================================================================
+#include "LinkerMap.h"
+
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+static bool isHex(StringRef S) {
+  unsigned long long V;
+  return S.startswith("0x") && !S.getAsInteger(0, V);
+}
+
+// ".text.foo", ".text.unlikely.foo", ... -> "foo"
+static StringRef getFunctionFromSection(StringRef Section) {
+  if (!Section.consume_front(".text."))
+    return StringRef();
+  for (StringRef Prefix : {"unlikely.", "startup.", "hot.", "exit."})
+    if (Section.consume_front(Prefix))
+      break;
+  return Section;
+}
+
+unsigned LinkerMap::getOrAddOrigin(StringRef Origin) {
+  auto Ins = OriginIds.try_emplace(Origin, Origins.size());
+  if (Ins.second)
+    Origins.push_back(Origin.str());
+  return Ins.first->second;
+}
+
+void LinkerMap::addSymbol(StringRef Symbol, unsigned Origin) {
+  if (!Symbol.empty())
+    Symbols.try_emplace(Symbol, Origin);
+}
+
+unsigned LinkerMap::lookup(StringRef Symbol) const {
+  auto It = Symbols.find(Symbol);
+  return It == Symbols.end() ? None : It->second;
+}
+
+Error LinkerMap::load(StringRef Path) {
+  auto Buf = MemoryBuffer::getFile(Path);
+  if (!Buf)
+    return createStringError(Buf.getError(), "cannot read '%s'",
+                             Path.str().c_str());
+
+  // An input section name that is too long is printed on its own line, and
+  // its address, size and origin on the next one
+  StringRef PendingSection;
+  unsigned CurOrigin = None;
+  for (line_iterator It(**Buf, /*SkipBlanks=*/true), E; It != E; ++It) {
+    StringRef Line = *It;
+    if (!Line.startswith(" ")) {
+      // Output sections and headers
+      PendingSection = StringRef();
+      CurOrigin = None;
+      continue;
+    }
+
+    SmallVector<StringRef, 4> Tokens;
+    Line.split(Tokens, ' ', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+    if (Tokens.empty())
+      continue;
+
+    StringRef Section;
+    size_t First;
+    if (Tokens[0].startswith(".")) {
+      if (Tokens.size() == 1) {
+        PendingSection = Tokens[0];
+        continue;
+      }
+      Section = Tokens[0];
+      First = 1;
+    } else if (!PendingSection.empty()) {
+      Section = PendingSection;
+      First = 0;
+    } else {
+      // "<address> <symbol>" lines, skipping assignments like ". = ALIGN (4)"
+      if (CurOrigin != None && Tokens.size() >= 2 && isHex(Tokens[0]) &&
+          !isHex(Tokens[1]) && !Line.contains(" = ") &&
+          !Tokens[1].startswith("PROVIDE"))
+        addSymbol(Line.drop_front(Tokens[1].data() - Line.data()).rtrim(),
+                  CurOrigin);
+      continue;
+    }
+    PendingSection = StringRef();
+
+    // "<section> <address> <size> <origin>", the origin may contain spaces
+    if (Tokens.size() < First + 3 || !isHex(Tokens[First]) ||
+        !isHex(Tokens[First + 1])) {
+      CurOrigin = None;
+      continue;
+    }
+    StringRef Origin =
+        Line.drop_front(Tokens[First + 2].data() - Line.data()).rtrim();
+    CurOrigin = getOrAddOrigin(Origin);
+    addSymbol(getFunctionFromSection(Section), CurOrigin);
+  }
+  return Error::success();
+}
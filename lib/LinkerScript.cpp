@@ -0,0 +1,239 @@
+//==============================================================================
+// FILE:
+//    LinkerScript.cpp
+//
+// DESCRIPTION:
+//    Reads the MEMORY command of a GNU ld script, e.g.:
+//
+//      MEMORY
+//      {
+//        FLASH (rx) : ORIGIN = 0x00000000, LENGTH = 0x78000
+//        RAM (rwx) :  ORIGIN = 0x20000000, LENGTH = 64K
+//      }
+//
+//    Origins and lengths may be expressions made of numbers (with K/M
+//    suffixes), + - * / and parentheses, and ORIGIN()/LENGTH() of regions
+//    declared earlier. Anything else in the script is ignored.
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+using namespace llvm;
+
+namespace {
+// Recursive-descent evaluator for the subset of ld expressions used in
+// MEMORY commands
+class ExprParser {
+public:
+  ExprParser(StringRef Expr, const StringMap<std::pair<uint64_t, uint64_t>> &R)
+      : Cur(Expr), Regions(R) {}
+
+  bool parse(uint64_t &Res) {
+    if (!parseSum(Res))
+      return false;
+    return Cur.ltrim().empty();
+  }
+
+private:
+  bool consume(StringRef Tok) {
+    Cur = Cur.ltrim();
+    return Cur.consume_front(Tok);
+  }
+
+  bool parseSum(uint64_t &Res) {
+    if (!parseProduct(Res))
+      return false;
+    for (;;) {
+      uint64_t RHS;
+      if (consume("+")) {
+        if (!parseProduct(RHS))
+          return false;
+        Res += RHS;
+      } else if (consume("-")) {
+        if (!parseProduct(RHS))
+          return false;
+        Res -= RHS;
+      } else {
+        return true;
+      }
+    }
+  }
+
+  bool parseProduct(uint64_t &Res) {
+    if (!parsePrimary(Res))
+      return false;
+    for (;;) {
+      uint64_t RHS;
+      if (consume("*")) {
+        if (!parsePrimary(RHS))
+          return false;
+        Res *= RHS;
+      } else if (consume("/")) {
+        if (!parsePrimary(RHS) || RHS == 0)
+          return false;
+        Res /= RHS;
+      } else {
+        return true;
+      }
+    }
+  }
+
+  bool parsePrimary(uint64_t &Res) {
+    if (consume("(")) {
+      if (!parseSum(Res))
+        return false;
+      return consume(")");
+    }
+
+    Cur = Cur.ltrim();
+    size_t Len = Cur.find_if_not(
+        [](char C) { return isAlnum(C) || C == '_' || C == '.'; });
+    StringRef Tok = Cur.take_front(Len);
+    Cur = Cur.drop_front(Tok.size());
+    if (Tok.empty())
+      return false;
+
+    // ORIGIN(<region>) / LENGTH(<region>)
+    bool IsOrigin = Tok == "ORIGIN" || Tok == "org" || Tok == "o";
+    bool IsLength = Tok == "LENGTH" || Tok == "len" || Tok == "l";
+    if (IsOrigin || IsLength) {
+      if (!consume("("))
+        return false;
+      Cur = Cur.ltrim();
+      StringRef Name = Cur.take_until([](char C) { return C == ')'; }).trim();
+      Cur = Cur.drop_until([](char C) { return C == ')'; });
+      auto It = Regions.find(Name);
+      if (It == Regions.end() || !consume(")"))
+        return false;
+      Res = IsOrigin ? It->second.first : It->second.second;
+      return true;
+    }
+
+    uint64_t Mult = 1;
+    if (Tok.endswith_insensitive("k") && !Tok.startswith_insensitive("0x")) {
+      Mult = 1024;
+      Tok = Tok.drop_back();
+    } else if (Tok.endswith_insensitive("m") &&
+               !Tok.startswith_insensitive("0x")) {
+      Mult = 1024 * 1024;
+      Tok = Tok.drop_back();
+    }
+    if (Tok.getAsInteger(0, Res))
+      return false;
+    Res *= Mult;
+    return true;
+  }
+
+  StringRef Cur;
+  const StringMap<std::pair<uint64_t, uint64_t>> &Regions;
+};
+} // namespace
+
+static std::string stripComments(StringRef Text) {
+  std::string Res;
+  Res.reserve(Text.size());
+  while (!Text.empty()) {
+    size_t Start = Text.find("/*");
+    Res += Text.take_front(Start).str();
+    if (Start == StringRef::npos)
+      break;
+    size_t End = Text.find("*/", Start + 2);
+    if (End == StringRef::npos)
+      break;
+    Res += ' ';
+    Text = Text.drop_front(End + 2);
+  }
+  return Res;
+}
+
+// Parses "<expr>" up to the next top-level ',' (or the end of Entry)
+static StringRef takeExpr(StringRef &Entry) {
+  int Depth = 0;
+  size_t I = 0;
+  for (; I < Entry.size(); ++I) {
+    if (Entry[I] == '(')
+      ++Depth;
+    else if (Entry[I] == ')')
+      --Depth;
+    else if (Entry[I] == ',' && Depth == 0)
+      break;
+  }
+  StringRef Expr = Entry.take_front(I);
+  Entry = Entry.drop_front(std::min(I + 1, Entry.size()));
+  return Expr.trim();
+}
+
+Error loadLinkerScriptMemory(StringRef Path, RegionTable &Regions) {
+  auto Buf = MemoryBuffer::getFile(Path);
+  if (!Buf)
+    return createStringError(Buf.getError(), "cannot read '%s'",
+                             Path.str().c_str());
+  std::string Text = stripComments((*Buf)->getBuffer());
+  StringRef Script(Text);
+
+  // Find "MEMORY {" as a whole word
+  size_t Pos = 0;
+  for (;;) {
+    Pos = Script.find("MEMORY", Pos);
+    if (Pos == StringRef::npos)
+      return Error::success();
+    bool WordStart = Pos == 0 || !isAlnum(Script[Pos - 1]);
+    StringRef Rest = Script.drop_front(Pos + 6).ltrim();
+    if (WordStart && Rest.startswith("{")) {
+      Script = Rest.drop_front();
+      break;
+    }
+    Pos += 6;
+  }
+  StringRef Block = Script.take_until([](char C) { return C == '}'; });
+
+  StringMap<std::pair<uint64_t, uint64_t>> Declared;
+  SmallVector<StringRef, 8> Lines;
+  Block.split(Lines, '\n', -1, /*KeepEmpty=*/false);
+  for (StringRef Line : Lines) {
+    // <name> [(<attr>)] : ORIGIN = <expr>, LENGTH = <expr>
+    size_t Colon = Line.find(':');
+    if (Colon == StringRef::npos)
+      continue;
+    StringRef Name = Line.take_front(Colon)
+                         .take_until([](char C) { return C == '('; })
+                         .trim();
+    StringRef Entry = Line.drop_front(Colon + 1);
+
+    uint64_t Origin = 0, Length = 0;
+    bool HasOrigin = false, HasLength = false;
+    while (!Entry.trim().empty()) {
+      StringRef Assign = takeExpr(Entry);
+      StringRef Key = Assign.take_until([](char C) { return C == '='; }).trim();
+      StringRef Expr = Assign.drop_until([](char C) { return C == '='; });
+      if (Expr.empty())
+        break;
+      uint64_t Val;
+      if (!ExprParser(Expr.drop_front(), Declared).parse(Val))
+        return createStringError(inconvertibleErrorCode(),
+                                 "%s: cannot evaluate '%s'",
+                                 Path.str().c_str(), Assign.str().c_str());
+      if (StringSwitch<bool>(Key).Cases("ORIGIN", "org", "o", true)
+              .Default(false)) {
+        Origin = Val;
+        HasOrigin = true;
+      } else if (StringSwitch<bool>(Key).Cases("LENGTH", "len", "l", true)
+                     .Default(false)) {
+        Length = Val;
+        HasLength = true;
+      }
+    }
+    if (Name.empty() || !HasOrigin || !HasLength)
+      continue;
+
+    Declared[Name] = {Origin, Length};
+    if (Length)
+      Regions.add({Origin, Origin + Length, Name.str(), Region::Memory});
+  }
+  return Error::success();
+}
@@ -0,0 +1,207 @@
+//==============================================================================
+// FILE:
+//    MemoryMap.cpp
+//
+// DESCRIPTION:
+//    Target memory-map profiles. Select one with:
+//
+//      -mmio-profile=<any|cortex-m|nrf52|stm32|riscv>
+//
+//    With the default, `any`, every constant address counts as MMIO. With a
+//    target profile, constant accesses to flash, RAM and other non-device
+//    memory are ignored.
+//
+//    The memory regions of the target can also be read from its GNU ld
+//    linker script(s). Constant addresses inside the declared regions (FLASH,
+//    RAM, ...) are never MMIO:
+//
+//      -linker-script=src/nrf_common.ld
+//
+//    Peripheral names come from a devicetree (.dts or Zephyr's
+//    devicetree_generated.h). MMIO findings are then annotated with the node
+//    label of the peripheral they access, e.g. "&spi0+0x544":
+//
+//      -devicetree=build/zephyr/zephyr.dts
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+
+#include "llvm/Support/CommandLine.h"
+#include <algorithm>
+
+using namespace llvm;
+
+static cl::opt<MemoryProfile> MMIOProfile(
+    "mmio-profile", cl::desc("Target memory map used to recognise MMIO"),
+    cl::init(MemoryProfile::Any),
+    cl::values(clEnumValN(MemoryProfile::Any, "any",
+                          "Every constant address is MMIO"),
+               clEnumValN(MemoryProfile::CortexM, "cortex-m",
+                          "Arm Cortex-M peripheral and system regions"),
+               clEnumValN(MemoryProfile::NRF52, "nrf52", "Nordic nRF52"),
+               clEnumValN(MemoryProfile::STM32, "stm32", "ST STM32"),
+               clEnumValN(MemoryProfile::RISCV, "riscv",
+                          "RISC-V CLINT and PLIC")));
+
+static cl::list<std::string>
+    LinkerScripts("linker-script",
+                  cl::desc("GNU ld script whose MEMORY regions are not MMIO"),
+                  cl::value_desc("file"), cl::ZeroOrMore);
+
+static cl::list<std::string>
+    DeviceTrees("devicetree",
+                cl::desc("Devicetree (.dts or devicetree_generated.h) naming "
+                         "the peripherals"),
+                cl::value_desc("file"), cl::ZeroOrMore);
+
+// Out-of-line definitions for the ODR-used range tables (C++14)
+constexpr AddressRange profile::CortexM::MMIO[];
+constexpr AddressRange profile::NRF52::MMIO[];
+constexpr AddressRange profile::STM32::MMIO[];
+constexpr AddressRange profile::RISCV::MMIO[];
+
+static_assert(profile::NRF52::isMMIO(0x40003000), "TWIM0 is MMIO");
+static_assert(!profile::NRF52::isMMIO(0x20000000), "RAM isn't MMIO");
+static_assert(!profile::CortexM::isMMIO(0x00001000), "Flash isn't MMIO");
+
+AddressPredicate getMMIOPredicate(MemoryProfile P) {
+  switch (P) {
+  case MemoryProfile::CortexM:
+    return &profile::CortexM::isMMIO;
+  case MemoryProfile::NRF52:
+    return &profile::NRF52::isMMIO;
+  case MemoryProfile::STM32:
+    return &profile::STM32::isMMIO;
+  case MemoryProfile::RISCV:
+    return &profile::RISCV::isMMIO;
+  case MemoryProfile::Any:
+    break;
+  }
+  return &profile::Any::isMMIO;
+}
+
+ArrayRef<AddressRange> getMMIORanges(MemoryProfile P) {
+  switch (P) {
+  case MemoryProfile::CortexM:
+    return profile::CortexM::MMIO;
+  case MemoryProfile::NRF52:
+    return profile::NRF52::MMIO;
+  case MemoryProfile::STM32:
+    return profile::STM32::MMIO;
+  case MemoryProfile::RISCV:
+    return profile::RISCV::MMIO;
+  case MemoryProfile::Any:
+    break;
+  }
+  return None;
+}
+
+//------------------------------------------------------------------------------
+// RegionTable
+//------------------------------------------------------------------------------
+void RegionTable::sort() {
+  std::stable_sort(
+      Regions.begin(), Regions.end(),
+      [](const Region &A, const Region &B) { return A.Begin < B.Begin; });
+  MaxEnd.resize(Regions.size());
+  uint64_t Max = 0;
+  for (size_t I = 0; I < Regions.size(); ++I)
+    MaxEnd[I] = Max = std::max(Max, Regions[I].End);
+  Sorted = true;
+}
+
+const Region *RegionTable::find(uint64_t Addr) const {
+  assert(Sorted && "RegionTable::sort() not called");
+  // The last region starting at or below Addr
+  auto It = std::upper_bound(
+      Regions.begin(), Regions.end(), Addr,
+      [](uint64_t A, const Region &R) { return A < R.Begin; });
+  // Walk back over the regions that start at or below Addr, as long as one of
+  // them may still extend past it
+  for (size_t I = It - Regions.begin(); I > 0 && MaxEnd[I - 1] > Addr; --I)
+    if (Addr < Regions[I - 1].End)
+      return &Regions[I - 1];
+  return nullptr;
+}
+
+//------------------------------------------------------------------------------
+// AddressClassifier
+//------------------------------------------------------------------------------
+void AddressClassifier::configure() {
+  if (Configured)
+    return;
+  Configured = true;
+
+  IsMMIOAddr = getMMIOPredicate(MMIOProfile);
+  for (const AddressRange &R : getMMIORanges(MMIOProfile)) {
+    MMIOBegins.push_back(R.Begin);
+    MMIOSizes.push_back(R.End - R.Begin);
+  }
+  HasMMIORanges = !MMIOBegins.empty();
+
+  RegionTable Loaded;
+  for (const std::string &Script : LinkerScripts)
+    if (Error E = loadLinkerScriptMemory(Script, Loaded))
+      logAllUnhandledErrors(std::move(E), errs(), "-linker-script: ");
+  for (const std::string &DT : DeviceTrees)
+    if (Error E = loadDeviceTree(DT, Loaded))
+      logAllUnhandledErrors(std::move(E), errs(), "-devicetree: ");
+  for (const Region &R : Loaded.regions()) {
+    if (R.Kind == Region::Memory) {
+      MemoryBegins.push_back(R.Begin);
+      MemorySizes.push_back(R.End - R.Begin);
+      MemoryRegions.add(R);
+    } else {
+      Peripherals.add(R);
+    }
+  }
+  MemoryRegions.sort();
+  Peripherals.sort();
+}
+
+//------------------------------------------------------------------------------
+// nRF5x register layout
+//------------------------------------------------------------------------------
+NRFRegister getNRFRegister(uint64_t Offset) {
+  if (Offset < 0x100)
+    return NRFRegister::Task;
+  if (Offset < 0x200)
+    return NRFRegister::Event;
+  switch (Offset) {
+  case 0x200:
+    return NRFRegister::Shorts;
+  case 0x300:
+    return NRFRegister::IntEn;
+  case 0x304:
+    return NRFRegister::IntEnSet;
+  case 0x308:
+    return NRFRegister::IntEnClr;
+  case 0x500:
+    return NRFRegister::Enable;
+  default:
+    return NRFRegister::Other;
+  }
+}
+
+const char *getNRFRegisterName(NRFRegister R) {
+  switch (R) {
+  case NRFRegister::Task:
+    return "TASKS";
+  case NRFRegister::Event:
+    return "EVENTS";
+  case NRFRegister::Shorts:
+    return "SHORTS";
+  case NRFRegister::IntEn:
+    return "INTEN";
+  case NRFRegister::IntEnSet:
+    return "INTENSET";
+  case NRFRegister::IntEnClr:
+    return "INTENCLR";
+  case NRFRegister::Enable:
+    return "ENABLE";
+  case NRFRegister::Other:
+    break;
+  }
+  return nullptr;
+}
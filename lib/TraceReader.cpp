@@ -0,0 +1,172 @@
+//==============================================================================
+// FILE:
+//    TraceReader.cpp
+//
+// DESCRIPTION:
+//    Reads the peripheral access logs of emulators (Renode, QEMU with a
+//    logging device, custom instrumentation). The formats differ in details,
+//    so lines are parsed by keyword rather than by position:
+//      * the PC follows "pc" or "cpu:" (or is the first hex number),
+//      * the address follows "addr", "address", "from", "to" or "@" (or is
+//        the next hex number),
+//      * "read"/"R" and "write"/"W" give the direction, and
+//      * a "<file>:<line>" token (e.g. added by addr2line) gives the source
+//        line.
+//
+//    Trace files are read in 1 MiB chunks, with no other per-line state,
+//    so multi-GB traces run in constant memory.
+//
+// License: MIT
+//==============================================================================
+#include "TraceReader.h"
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include <cstring>
+#include <vector>
+
+using namespace llvm;
+
+//------------------------------------------------------------------------------
+// Parsing
+//------------------------------------------------------------------------------
+static bool parseHex(StringRef Tok, uint64_t &Val) {
+  Tok = Tok.rtrim(".,;:");
+  if (!Tok.consume_front("0x") && !Tok.consume_front("0X"))
+    return false;
+  return !Tok.empty() && !Tok.getAsInteger(16, Val);
+}
+
+// "src/drivers/Spi.cpp:42" (or "...:42:7")
+static bool parseSourceLoc(StringRef Tok, StringRef &File, unsigned &Line) {
+  SmallVector<StringRef, 3> Parts;
+  Tok.split(Parts, ':');
+  if (Parts.size() < 2 || !Parts[0].contains('.') ||
+      Parts[1].getAsInteger(10, Line))
+    return false;
+  File = Parts[0];
+  return true;
+}
+
+bool parseTraceLine(StringRef Line, TraceAccess &A) {
+  A = TraceAccess();
+  SmallVector<StringRef, 16> Toks;
+  SplitString(Line, Toks, " \t\r,[](){}'\"");
+
+  enum { None, WantPC, WantAddr } Want = None;
+  bool HasAddr = false;
+  SmallVector<uint64_t, 4> Unclaimed;
+  auto Claim = [&](uint64_t Val) {
+    if (Want == WantPC && !A.PC) {
+      A.PC = Val;
+    } else if (Want == WantAddr && !HasAddr) {
+      A.Addr = Val;
+      HasAddr = true;
+    } else {
+      Unclaimed.push_back(Val);
+    }
+    Want = None;
+  };
+
+  for (StringRef Tok : Toks) {
+    // "pc 0x1a2c", "pc=0x1a2c", "cpu: 0x1a2c", ...
+    StringRef Key, Value;
+    std::tie(Key, Value) = Tok.split('=');
+    StringRef K = Key.rtrim(':');
+    bool IsPC = K.equals_insensitive("pc") || K.equals_insensitive("cpu");
+    if (IsPC || K.equals_insensitive("addr") ||
+        K.equals_insensitive("address") || K.equals_insensitive("from") ||
+        K.equals_insensitive("to") || K == "@") {
+      Want = IsPC ? WantPC : WantAddr;
+      uint64_t Val;
+      if (parseHex(Value, Val))
+        Claim(Val);
+      continue;
+    }
+
+    uint64_t Val;
+    if (parseHex(Tok, Val))
+      Claim(Val);
+    else if (K.contains_insensitive("write") || K.equals_insensitive("w"))
+      A.Kind = TraceAccess::Write;
+    else if (K.contains_insensitive("read") || K.equals_insensitive("r"))
+      A.Kind = TraceAccess::Read;
+    else if (A.File.empty())
+      parseSourceLoc(Tok, A.File, A.Line);
+  }
+
+  // Plain format: "<pc> <addr> ..." or "<addr> ..."
+  size_t Next = 0;
+  if (!HasAddr && !A.PC && Unclaimed.size() >= 2)
+    A.PC = Unclaimed[Next++];
+  if (!HasAddr && Next < Unclaimed.size()) {
+    A.Addr = Unclaimed[Next];
+    HasAddr = true;
+  }
+  return HasAddr;
+}
+
+//------------------------------------------------------------------------------
+// Streaming
+//------------------------------------------------------------------------------
+Error forEachTraceLine(StringRef Path, function_ref<void(StringRef)> Fn,
+                       uint64_t *Skipped) {
+  static constexpr size_t ChunkSize = 1 << 20;
+  sys::fs::file_t FD;
+  bool IsStdin = Path == "-";
+  if (IsStdin) {
+    FD = sys::fs::getStdinHandle();
+  } else {
+    Expected<sys::fs::file_t> Opened = sys::fs::openNativeFileForRead(Path);
+    if (!Opened)
+      return Opened.takeError();
+    FD = *Opened;
+  }
+
+  std::vector<char> Buf(ChunkSize);
+  size_t Have = 0;
+  // Inside a line longer than the buffer
+  bool Overlong = false;
+  for (;;) {
+    Expected<size_t> Read = sys::fs::readNativeFile(
+        FD, MutableArrayRef<char>(Buf).drop_front(Have));
+    if (!Read) {
+      if (!IsStdin)
+        sys::fs::closeFile(FD);
+      return Read.takeError();
+    }
+    bool Eof = *Read == 0;
+    Have += *Read;
+
+    StringRef Data(Buf.data(), Have);
+    size_t Start = 0;
+    for (size_t NL; (NL = Data.find('\n', Start)) != StringRef::npos;
+         Start = NL + 1) {
+      if (Overlong)
+        Overlong = false;
+      else
+        Fn(Data.slice(Start, NL));
+    }
+    // The last line may have no newline
+    if (Eof) {
+      if (Start < Have && !Overlong)
+        Fn(Data.drop_front(Start));
+      break;
+    }
+    // Keep the incomplete line for the next chunk
+    if (Start == 0 && Have == Buf.size()) {
+      if (!Overlong && Skipped)
+        ++*Skipped;
+      Overlong = true;
+      Have = 0;
+      continue;
+    }
+    std::memmove(Buf.data(), Buf.data() + Start, Have - Start);
+    Have -= Start;
+  }
+
+  if (!IsStdin)
+    sys::fs::closeFile(FD);
+  return Error::success();
+}
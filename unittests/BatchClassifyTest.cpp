@@ -0,0 +1,126 @@
+//==============================================================================
+// FILE:
+//    BatchClassifyTest.cpp
+//
+// DESCRIPTION:
+//    Checks the SIMD kernels of AddressClassifier::classify against the
+//    scalar loop and inRange(), at the range bounds and at the addresses
+//    where the biased signed comparison could go wrong (0, 2^31, 2^32 - 1,
+//    2^63, 2^64 - 1).
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+
+#include "gtest/gtest.h"
+#include <vector>
+
+namespace {
+
+const ClassifyKernel Kernels[] = {ClassifyKernel::Scalar,
+                                  ClassifyKernel::SSE42, ClassifyKernel::AVX2};
+
+const char *getName(ClassifyKernel K) {
+  switch (K) {
+  case ClassifyKernel::Scalar:
+    return "scalar";
+  case ClassifyKernel::SSE42:
+    return "sse4.2";
+  case ClassifyKernel::AVX2:
+    return "avx2";
+  }
+  return "?";
+}
+
+// Every address next to a bound of Ranges, plus the interesting constants
+std::vector<uint64_t> getEdgeAddresses(llvm::ArrayRef<AddressRange> Ranges) {
+  std::vector<uint64_t> Addrs = {0,
+                                 1,
+                                 0x7FFFFFFF,
+                                 0x80000000,
+                                 0x80000001,
+                                 0xFFFFFFFF,
+                                 0x100000000,
+                                 0x7FFFFFFFFFFFFFFF,
+                                 0x8000000000000000,
+                                 0xFFFFFFFFFFFFFFFF};
+  for (const AddressRange &R : Ranges)
+    for (uint64_t Bound : {R.Begin, R.End})
+      for (uint64_t Addr : {Bound - 1, Bound, Bound + 1})
+        Addrs.push_back(Addr);
+  return Addrs;
+}
+
+// Runs every supported kernel on Addrs and compares the verdicts with
+// inRange(), one address count at a time so that the SIMD loops are
+// checked with every remainder
+void checkKernels(llvm::ArrayRef<AddressRange> Ranges,
+                  llvm::ArrayRef<uint64_t> Addrs) {
+  std::vector<uint64_t> Begins, Sizes;
+  for (const AddressRange &R : Ranges) {
+    Begins.push_back(R.Begin);
+    Sizes.push_back(R.End - R.Begin);
+  }
+
+  for (ClassifyKernel K : Kernels) {
+    if (!isClassifyKernelSupported(K))
+      continue;
+    for (size_t N = 0; N <= Addrs.size(); ++N) {
+      std::vector<uint8_t> Out(N, 0xAA);
+      inAnyRange(K, Addrs.take_front(N), Begins, Sizes, Out);
+      for (size_t I = 0; I < N; ++I) {
+        bool Expected = false;
+        for (const AddressRange &R : Ranges)
+          Expected |= inRange(R, Addrs[I]);
+        EXPECT_EQ(Out[I], Expected)
+            << getName(K) << ", " << N << " addresses, address 0x"
+            << std::hex << Addrs[I];
+      }
+    }
+  }
+}
+
+TEST(BatchClassify, ScalarIsAlwaysSupported) {
+  EXPECT_TRUE(isClassifyKernelSupported(ClassifyKernel::Scalar));
+}
+
+TEST(BatchClassify, CortexMBounds) {
+  llvm::ArrayRef<AddressRange> Ranges = getMMIORanges(MemoryProfile::CortexM);
+  checkKernels(Ranges, getEdgeAddresses(Ranges));
+}
+
+TEST(BatchClassify, NRF52Bounds) {
+  llvm::ArrayRef<AddressRange> Ranges = getMMIORanges(MemoryProfile::NRF52);
+  checkKernels(Ranges, getEdgeAddresses(Ranges));
+}
+
+// Ranges that start at 0, cross 2^31 and 2^63, and end at the top of the
+// address space
+TEST(BatchClassify, AddressSpaceEdges) {
+  const AddressRange Ranges[] = {
+      {0, 0x1000, "Low"},
+      {0x7FFFF000, 0x80001000, "Across 2^31"},
+      {0xFFFFF000, 0x100001000, "Across 2^32"},
+      {0x7FFFFFFFFFFFF000, 0x8000000000001000, "Across 2^63"},
+      {0xFFFFFFFFFFFFF000, 0xFFFFFFFFFFFFFFFF, "High"},
+  };
+  checkKernels(Ranges, getEdgeAddresses(Ranges));
+}
+
+TEST(BatchClassify, EmptyRange) {
+  const AddressRange Ranges[] = {{0x40000000, 0x40000000, "Empty"}};
+  checkKernels(Ranges, getEdgeAddresses(Ranges));
+}
+
+TEST(BatchClassify, NoRanges) {
+  uint64_t Addrs[] = {0, 0x80000000, 0xFFFFFFFF, 0xFFFFFFFFFFFFFFFF, 42};
+  for (ClassifyKernel K : Kernels) {
+    if (!isClassifyKernelSupported(K))
+      continue;
+    std::vector<uint8_t> Out(5, 0xAA);
+    inAnyRange(K, Addrs, {}, {}, Out);
+    EXPECT_EQ(Out, std::vector<uint8_t>(5, 0)) << getName(K);
+  }
+}
+
+} // namespace
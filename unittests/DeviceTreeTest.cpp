@@ -0,0 +1,172 @@
+//==============================================================================
+// FILE:
+//    DeviceTreeTest.cpp
+//
+// DESCRIPTION:
+//    Tests for loadDeviceTree, on devicetree sources (.dts) and on Zephyr's
+//    devicetree_generated.h.
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+#include "TempFile.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+const Region *findRegion(const RegionTable &Regions, StringRef Name) {
+  for (const Region &R : Regions.regions())
+    if (R.Name == Name)
+      return &R;
+  return nullptr;
+}
+
+TEST(DeviceTree, Source) {
+  TempFile DTS(".dts", R"(
+/dts-v1/;
+/ {
+	#address-cells = <1>;
+	#size-cells = <1>;
+	model = "test; board { with } braces";
+	soc {
+		#address-cells = <1>;
+		#size-cells = <1>;
+		flash-controller@4001e000 {
+			reg = <0x4001e000 0x1000>;
+			#address-cells = <1>;
+			#size-cells = <1>;
+			flash0: flash@0 { reg = <0x0 0x80000>; };
+		};
+		sram0: memory@20000000 { reg = <0x20000000 0x10000>; };
+		spi1: twi1: spi@40004000 { // comment
+			reg = <0x40004000 0x1000>;
+			status = "okay";
+		};
+		/* disabled: gpio@50000000 { reg = <0x50000000 0x1000>; }; */
+		gpiote: gpiote@40006000 { reg = <0x40006000 0x1000>, <0x40007000 0x100>; };
+		nvic: interrupt-controller@e000e100 { reg = <0xe000e100 0xc00>; };
+		empty@40009000 { reg = <0x40009000 0x0>; };
+	};
+};
+)");
+  RegionTable Regions;
+  Error E = loadDeviceTree(DTS.path(), Regions);
+  ASSERT_FALSE(E) << toString(std::move(E));
+
+  const Region *R = findRegion(Regions, "flash-controller@4001e000");
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->Begin, 0x4001e000u);
+  EXPECT_EQ(R->End, 0x4001f000u);
+  EXPECT_EQ(R->Kind, Region::Peripheral);
+
+  R = findRegion(Regions, "&flash0");
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->Begin, 0x0u);
+  EXPECT_EQ(R->End, 0x80000u);
+  EXPECT_EQ(R->Kind, Region::Memory);
+
+  R = findRegion(Regions, "&sram0");
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->Begin, 0x20000000u);
+  EXPECT_EQ(R->Kind, Region::Memory);
+
+  // The first label names the node
+  R = findRegion(Regions, "&spi1");
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->Begin, 0x40004000u);
+  EXPECT_EQ(R->End, 0x40005000u);
+  EXPECT_EQ(R->Kind, Region::Peripheral);
+  EXPECT_FALSE(findRegion(Regions, "&twi1"));
+
+  EXPECT_TRUE(findRegion(Regions, "&nvic"));
+  EXPECT_FALSE(findRegion(Regions, "empty@40009000"));
+
+  // One region per reg entry
+  Regions.sort();
+  ASSERT_TRUE(Regions.find(0x40006000));
+  EXPECT_EQ(Regions.find(0x40006000)->Name, "&gpiote");
+  ASSERT_TRUE(Regions.find(0x400070FF));
+  EXPECT_EQ(Regions.find(0x400070FF)->Name, "&gpiote");
+  EXPECT_FALSE(Regions.find(0x40007100));
+  EXPECT_FALSE(Regions.find(0x50000000));
+  EXPECT_EQ(Regions.regions().size(), 7u);
+}
+
+TEST(DeviceTree, TwoAddressCells) {
+  TempFile DTS(".dts", R"(
+/ {
+	soc {
+		#address-cells = <2>;
+		#size-cells = <1>;
+		uart0: serial@1_10013000 { reg = <0x1 0x10013000 0x1000>; };
+	};
+};
+)");
+  RegionTable Regions;
+  Error E = loadDeviceTree(DTS.path(), Regions);
+  ASSERT_FALSE(E) << toString(std::move(E));
+  ASSERT_EQ(Regions.regions().size(), 1u);
+  EXPECT_EQ(Regions.regions()[0].Name, "&uart0");
+  EXPECT_EQ(Regions.regions()[0].Begin, 0x110013000u);
+  EXPECT_EQ(Regions.regions()[0].End, 0x110014000u);
+}
+
+TEST(DeviceTree, MalformedReg) {
+  TempFile DTS(".dts", R"(
+/ {
+	#address-cells = <1>;
+	#size-cells = <1>;
+	spi@40003000 { reg = <0x40003000>; };
+};
+)");
+  RegionTable Regions;
+  EXPECT_TRUE(errorToBool(loadDeviceTree(DTS.path(), Regions)));
+}
+
+TEST(DeviceTree, ZephyrHeader) {
+  TempFile Header(".h", R"(
+#define DT_N_S_soc_S_spi_40003000_REG_NUM 1
+#define DT_N_S_soc_S_spi_40003000_REG_IDX_0_VAL_ADDRESS 1073754112 /* 0x40003000 */
+#define DT_N_S_soc_S_spi_40003000_REG_IDX_0_VAL_SIZE 4096 /* 0x1000 */
+#define DT_N_NODELABEL_spi0 DT_N_S_soc_S_spi_40003000
+#define DT_N_S_soc_S_memory_20000000_REG_IDX_0_VAL_ADDRESS 536870912
+#define DT_N_S_soc_S_memory_20000000_REG_IDX_0_VAL_SIZE 65536
+#define DT_N_S_soc_S_gpio_50000000_REG_IDX_0_VAL_ADDRESS 0x50000000
+#define DT_N_S_soc_S_gpio_50000000_REG_IDX_0_VAL_SIZE 0x200
+#define DT_N_S_soc_S_gpio_50000000_REG_IDX_1_VAL_ADDRESS 0x50000500
+#define DT_N_S_soc_S_gpio_50000000_REG_IDX_1_VAL_SIZE 0x300
+)");
+  RegionTable Regions;
+  Error E = loadDeviceTree(Header.path(), Regions);
+  ASSERT_FALSE(E) << toString(std::move(E));
+
+  const Region *R = findRegion(Regions, "&spi0");
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->Begin, 0x40003000u);
+  EXPECT_EQ(R->End, 0x40004000u);
+  EXPECT_EQ(R->Kind, Region::Peripheral);
+
+  // No label: the node name
+  R = findRegion(Regions, "memory@20000000");
+  ASSERT_TRUE(R);
+  EXPECT_EQ(R->Begin, 0x20000000u);
+  EXPECT_EQ(R->End, 0x20010000u);
+  EXPECT_EQ(R->Kind, Region::Memory);
+
+  Regions.sort();
+  ASSERT_TRUE(Regions.find(0x50000500));
+  EXPECT_EQ(Regions.find(0x50000500)->Name, "gpio@50000000");
+  EXPECT_FALSE(Regions.find(0x50000200));
+  EXPECT_EQ(Regions.regions().size(), 4u);
+}
+
+TEST(DeviceTree, MissingFile) {
+  RegionTable Regions;
+  EXPECT_TRUE(
+      errorToBool(loadDeviceTree("/nonexistent/hal-bypass.dts", Regions)));
+}
+
+} // namespace
@@ -0,0 +1,103 @@
+//==============================================================================
+// FILE:
+//    LinkerScriptTest.cpp
+//
+// DESCRIPTION:
+//    Tests for loadLinkerScriptMemory: region attributes, K/M suffixes,
+//    expressions with ORIGIN()/LENGTH(), comments and malformed entries.
+//
+// License: MIT
+//==============================================================================
+#include "MemoryMap.h"
+#include "TempFile.h"
+
+#include "gtest/gtest.h"
+
+using namespace llvm;
+
+namespace {
+
+TEST(LinkerScript, Memory) {
+  TempFile Script(".ld", R"(
+/* nRF52832, with a bootloader at the end of flash */
+SEARCH_DIR(.)
+MEMORY
+{
+  FLASH (rx) : ORIGIN = 0x00000000, LENGTH = 0x78000
+  RAM (rwx) :  ORIGIN = 0x20000000, LENGTH = 64K
+  BOOT (rx) : ORIGIN = ORIGIN(FLASH) + LENGTH(FLASH), LENGTH = 512K - (0x78000 + 4 * 1024)
+  EMPTY (r) : ORIGIN = 0x30000000, LENGTH = 0
+  EXT : org = 0x60000000, len = 2M
+}
+SECTIONS { .text : { *(.text*) } > FLASH }
+)");
+  RegionTable Regions;
+  Error E = loadLinkerScriptMemory(Script.path(), Regions);
+  ASSERT_FALSE(E) << toString(std::move(E));
+
+  const std::vector<Region> &R = Regions.regions();
+  // EMPTY has no size and isn't added
+  ASSERT_EQ(R.size(), 4u);
+  EXPECT_EQ(R[0].Name, "FLASH");
+  EXPECT_EQ(R[0].Begin, 0x0u);
+  EXPECT_EQ(R[0].End, 0x78000u);
+  EXPECT_EQ(R[1].Name, "RAM");
+  EXPECT_EQ(R[1].Begin, 0x20000000u);
+  EXPECT_EQ(R[1].End, 0x20010000u);
+  EXPECT_EQ(R[2].Name, "BOOT");
+  EXPECT_EQ(R[2].Begin, 0x78000u);
+  EXPECT_EQ(R[2].End, 0x7F000u);
+  EXPECT_EQ(R[3].Name, "EXT");
+  EXPECT_EQ(R[3].Begin, 0x60000000u);
+  EXPECT_EQ(R[3].End, 0x60200000u);
+  for (const Region &Reg : R)
+    EXPECT_EQ(Reg.Kind, Region::Memory);
+
+  Regions.sort();
+  ASSERT_TRUE(Regions.find(0x20000000));
+  EXPECT_EQ(Regions.find(0x20000000)->Name, "RAM");
+  EXPECT_EQ(Regions.find(0x2000FFFF)->Name, "RAM");
+  EXPECT_FALSE(Regions.find(0x20010000));
+  EXPECT_FALSE(Regions.find(0x40000000));
+}
+
+// "MEMORY" inside another word or a comment isn't the MEMORY command
+TEST(LinkerScript, MemoryKeyword) {
+  TempFile Script(".ld", R"(
+/* MEMORY { FAKE : ORIGIN = 0, LENGTH = 1 } */
+__MEMORY_END = 0;
+MEMORY { RAM : ORIGIN = 0x20000000, LENGTH = 0x100 }
+)");
+  RegionTable Regions;
+  Error E = loadLinkerScriptMemory(Script.path(), Regions);
+  ASSERT_FALSE(E) << toString(std::move(E));
+  ASSERT_EQ(Regions.regions().size(), 1u);
+  EXPECT_EQ(Regions.regions()[0].Name, "RAM");
+}
+
+TEST(LinkerScript, NoMemory) {
+  TempFile Script(".ld", "SECTIONS { .text : { *(.text) } }\n");
+  RegionTable Regions;
+  Error E = loadLinkerScriptMemory(Script.path(), Regions);
+  ASSERT_FALSE(E) << toString(std::move(E));
+  EXPECT_TRUE(Regions.empty());
+}
+
+TEST(LinkerScript, BadExpression) {
+  TempFile Script(".ld", R"(
+MEMORY
+{
+  RAM : ORIGIN = ORIGIN(UNKNOWN), LENGTH = 64K
+}
+)");
+  RegionTable Regions;
+  EXPECT_TRUE(errorToBool(loadLinkerScriptMemory(Script.path(), Regions)));
+}
+
+TEST(LinkerScript, MissingFile) {
+  RegionTable Regions;
+  EXPECT_TRUE(errorToBool(
+      loadLinkerScriptMemory("/nonexistent/hal-bypass.ld", Regions)));
+}
+
+} // namespace
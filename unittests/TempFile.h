@@ -0,0 +1,39 @@
+//========================================================================
+// FILE:
+//    TempFile.h
+//
+// DESCRIPTION:
+//    A temporary file with the given contents, removed when it goes out of
+//    scope. The parsers under test read from paths.
+//
+// License: MIT
+//========================================================================
+#ifndef LLVM_TUTOR_TEMPFILE_H
+#define LLVM_TUTOR_TEMPFILE_H
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "gtest/gtest.h"
+
+class TempFile {
+public:
+  TempFile(llvm::StringRef Suffix, llvm::StringRef Contents) {
+    int FD;
+    std::error_code EC =
+        llvm::sys::fs::createTemporaryFile("hal-bypass-test", Suffix, FD, Path);
+    EXPECT_FALSE(EC) << EC.message();
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Contents;
+  }
+  ~TempFile() { llvm::sys::fs::remove(Path); }
+
+  llvm::StringRef path() const { return Path; }
+
+private:
+  llvm::SmallString<128> Path;
+};
+
+#endif // LLVM_TUTOR_TEMPFILE_H
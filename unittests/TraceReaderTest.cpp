@@ -0,0 +1,192 @@
+//==============================================================================
+// FILE:
+//    TraceReaderTest.cpp
+//
+// DESCRIPTION:
+//    Tests for parseTraceLine, on every supported trace format, and for
+//    forEachTraceLine: lines split across chunks, lines longer than a chunk
+//    and a last line without a newline.
+//
+// License: MIT
+//==============================================================================
+#include "TraceReader.h"
+#include "TempFile.h"
+
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+// The chunk size of forEachTraceLine
+constexpr size_t ChunkSize = 1 << 20;
+
+//------------------------------------------------------------------------------
+// parseTraceLine
+//------------------------------------------------------------------------------
+TEST(TraceReader, PlainFormat) {
+  TraceAccess A;
+  ASSERT_TRUE(parseTraceLine("0x00001a2c 0x40002500 W 0x4", A));
+  EXPECT_EQ(A.Addr, 0x40002500u);
+  ASSERT_TRUE(A.PC.hasValue());
+  EXPECT_EQ(*A.PC, 0x1a2cu);
+  EXPECT_EQ(A.Kind, TraceAccess::Write);
+  EXPECT_TRUE(A.File.empty());
+
+  // Address only
+  ASSERT_TRUE(parseTraceLine("0x40002500 R", A));
+  EXPECT_EQ(A.Addr, 0x40002500u);
+  EXPECT_FALSE(A.PC.hasValue());
+  EXPECT_EQ(A.Kind, TraceAccess::Read);
+}
+
+TEST(TraceReader, RenodeFormat) {
+  TraceAccess A;
+  ASSERT_TRUE(parseTraceLine("sysbus: [cpu: 0x1A2C] WriteUInt32 to "
+                             "0x40002500 (value 0x1)",
+                             A));
+  EXPECT_EQ(A.Addr, 0x40002500u);
+  ASSERT_TRUE(A.PC.hasValue());
+  EXPECT_EQ(*A.PC, 0x1a2cu);
+  EXPECT_EQ(A.Kind, TraceAccess::Write);
+
+  ASSERT_TRUE(parseTraceLine("sysbus: [cpu: 0x2000] ReadUInt32 from "
+                             "0x40003100, value 0x0",
+                             A));
+  EXPECT_EQ(A.Addr, 0x40003100u);
+  EXPECT_EQ(*A.PC, 0x2000u);
+  EXPECT_EQ(A.Kind, TraceAccess::Read);
+}
+
+TEST(TraceReader, KeyValueFormat) {
+  TraceAccess A;
+  ASSERT_TRUE(
+      parseTraceLine("t=12 pc=0x1a2c addr=0x40002500 write val=0x4", A));
+  EXPECT_EQ(A.Addr, 0x40002500u);
+  ASSERT_TRUE(A.PC.hasValue());
+  EXPECT_EQ(*A.PC, 0x1a2cu);
+  EXPECT_EQ(A.Kind, TraceAccess::Write);
+
+  // The address before the PC
+  ASSERT_TRUE(parseTraceLine("read @ 0x50000504 pc 0x3000", A));
+  EXPECT_EQ(A.Addr, 0x50000504u);
+  EXPECT_EQ(*A.PC, 0x3000u);
+  EXPECT_EQ(A.Kind, TraceAccess::Read);
+}
+
+TEST(TraceReader, SourceLocation) {
+  TraceAccess A;
+  ASSERT_TRUE(
+      parseTraceLine("0x1a2c 0x40002500 W src/drivers/Spi.cpp:42:7", A));
+  EXPECT_EQ(A.Addr, 0x40002500u);
+  EXPECT_EQ(A.File, "src/drivers/Spi.cpp");
+  EXPECT_EQ(A.Line, 42u);
+
+  // Not a source location
+  ASSERT_TRUE(parseTraceLine("0x1a2c 0x40002500 W cpu:core0", A));
+  EXPECT_TRUE(A.File.empty());
+}
+
+TEST(TraceReader, NoAccess) {
+  TraceAccess A;
+  EXPECT_FALSE(parseTraceLine("", A));
+  EXPECT_FALSE(parseTraceLine("   \t\r", A));
+  EXPECT_FALSE(parseTraceLine("# pc addr kind", A));
+  EXPECT_FALSE(parseTraceLine("sysbus: reset", A));
+  // Decimal numbers aren't addresses
+  EXPECT_FALSE(parseTraceLine("1234 5678 W", A));
+  // A PC alone
+  EXPECT_FALSE(parseTraceLine("pc=0x1a2c", A));
+}
+
+TEST(TraceReader, ResetsPreviousAccess) {
+  TraceAccess A;
+  ASSERT_TRUE(parseTraceLine("0x1a2c 0x40002500 W src/a.c:1", A));
+  ASSERT_TRUE(parseTraceLine("0x40003000", A));
+  EXPECT_EQ(A.Addr, 0x40003000u);
+  EXPECT_FALSE(A.PC.hasValue());
+  EXPECT_EQ(A.Kind, TraceAccess::Unknown);
+  EXPECT_TRUE(A.File.empty());
+  EXPECT_EQ(A.Line, 0u);
+}
+
+//------------------------------------------------------------------------------
+// forEachTraceLine
+//------------------------------------------------------------------------------
+std::vector<std::string> readLines(StringRef Path, uint64_t &Skipped) {
+  std::vector<std::string> Lines;
+  Skipped = 0;
+  Error E = forEachTraceLine(
+      Path, [&](StringRef Line) { Lines.push_back(Line.str()); }, &Skipped);
+  EXPECT_FALSE(E) << toString(std::move(E));
+  return Lines;
+}
+
+TEST(TraceReader, Lines) {
+  TempFile Trace(".log", "0x1 0x40000000 R\n\n0x2 0x40000004 W\n0x3");
+  uint64_t Skipped;
+  std::vector<std::string> Lines = readLines(Trace.path(), Skipped);
+  EXPECT_EQ(Lines, (std::vector<std::string>{"0x1 0x40000000 R", "",
+                                             "0x2 0x40000004 W", "0x3"}));
+  EXPECT_EQ(Skipped, 0u);
+}
+
+TEST(TraceReader, EmptyFile) {
+  TempFile Trace(".log", "");
+  uint64_t Skipped;
+  EXPECT_TRUE(readLines(Trace.path(), Skipped).empty());
+  EXPECT_EQ(Skipped, 0u);
+}
+
+// Lines that straddle the end of the first and of the second chunk, and a
+// line that fills a whole chunk including its newline
+TEST(TraceReader, ChunkBoundaries) {
+  std::vector<std::string> Expected;
+  std::string Text;
+  auto AddLine = [&](std::string Line) {
+    Text += Line + "\n";
+    Expected.push_back(std::move(Line));
+  };
+  AddLine(std::string(ChunkSize - 10, 'a'));
+  AddLine("0x1a2c 0x40002500 W"); // Across the first boundary
+  AddLine(std::string(ChunkSize - 1, 'b'));
+  while (Text.size() < 3 * ChunkSize - 5)
+    AddLine("0x1a2c 0x40002500 W");
+  Text += "0xffff 0x50000000 R"; // No newline
+
+  TempFile Trace(".log", Text);
+  uint64_t Skipped;
+  std::vector<std::string> Lines = readLines(Trace.path(), Skipped);
+  Expected.push_back("0xffff 0x50000000 R");
+  ASSERT_EQ(Lines.size(), Expected.size());
+  EXPECT_TRUE(Lines == Expected);
+  EXPECT_EQ(Skipped, 0u);
+}
+
+// Lines longer than a chunk are skipped as a whole, and counted once
+TEST(TraceReader, OverlongLines) {
+  std::string Text = "0x1 0x40000000 R\n";
+  Text += std::string(ChunkSize, 'x') + "\n";
+  Text += "0x2 0x40000004 W\n";
+  Text += std::string(3 * ChunkSize + 17, 'y') + "\n";
+  Text += "0x3 0x40000008 R\n";
+  Text += std::string(2 * ChunkSize, 'z'); // At the end, no newline
+
+  TempFile Trace(".log", Text);
+  uint64_t Skipped;
+  std::vector<std::string> Lines = readLines(Trace.path(), Skipped);
+  EXPECT_EQ(Lines, (std::vector<std::string>{
+                       "0x1 0x40000000 R", "0x2 0x40000004 W",
+                       "0x3 0x40000008 R"}));
+  EXPECT_EQ(Skipped, 3u);
+}
+
+TEST(TraceReader, MissingFile) {
+  Error E = forEachTraceLine("/nonexistent/hal-bypass.log",
+                             [](StringRef) { FAIL(); });
+  EXPECT_TRUE(errorToBool(std::move(E)));
+}
+
+} // namespace